@@ -49,75 +49,84 @@ int main() {
         ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, nullptr, nullptr);
         if (n < (ssize_t)sizeof(Packet)) { continue; }
 
-        const Packet* p = reinterpret_cast<const Packet*>(buf);
-        OrderMsg msg{};
-        msg.seq_num = ntohl(p->seq_num);
-        msg.order_id = ntohl(p->order_id);
-        msg.price_tick = ntohl(p->price_tick);
-        msg.qty = ntohl(p->qty);
-        msg.msg_type = p->msg_type;
-        msg.side = p->side;
-
-        switch (msg.msg_type) {
-            case MsgType::NewLimit:
-                if (msg.side == Order_Type::Buy) {
-                    book.bids.on_new_limit(msg.order_id, msg.price_tick, msg.qty);
-                } 
-                else {
-                    book.asks.on_new_limit(msg.order_id, msg.price_tick, msg.qty);
-                }
-                break;
-            case MsgType::Cancel:
-                if (msg.side == Order_Type::Buy) {
-                    book.bids.on_cancel(msg.order_id);
-                } 
-                else {
-                    book.asks.on_cancel(msg.order_id);
-                }
-                break;
-            case MsgType::Modify:
-                if (msg.side == Order_Type::Buy) {
-                    book.bids.on_modify(msg.order_id, msg.price_tick, msg.qty);
-                } 
-                else {
-                    book.asks.on_modify(msg.order_id, msg.price_tick, msg.qty);
-                }
-                break;
-            default:
-                break;
+        // v2 batch (BatchHeader + OrderWire entries) or a single v1 Packet
+        OrderMsg msgs[WIRE_V2_MAX_MSGS];
+        uint32_t count = 0;
+        BatchHeader h;
+        std::memcpy(&h, buf, sizeof(h));
+        if (h.version == WIRE_V2) { // v2 only, a bad count or length is dropped
+            if (h.count == 0 || h.count > WIRE_V2_MAX_MSGS ||
+                    (size_t)n != sizeof(BatchHeader) + h.count * sizeof(OrderWire)) { continue; }
+            for (; count < h.count; count++) {
+                OrderWire w;
+                std::memcpy(&w, buf + sizeof(BatchHeader) + count * sizeof(OrderWire), sizeof(w));
+                msgs[count] = OrderMsg{ntohl(h.first_seq) + count, ntohl(w.order_id), ntohl(w.price_tick),
+                                       ntohl(w.qty), w.msg_type, w.side, 0, ntohl(w.stop_tick), 0};
+            }
+        } 
+        else {
+            if (n != (ssize_t)sizeof(Packet)) { continue; }
+            const Packet* p = reinterpret_cast<const Packet*>(buf);
+            msgs[count++] = OrderMsg{ntohl(p->seq_num), ntohl(p->order_id), ntohl(p->price_tick),
+                                     ntohl(p->qty), p->msg_type, p->side, 0, ntohl(p->stop_tick), 0};
         }
 
-        uint32_t best_bid_price, best_ask_price;
-        while (book.bids.best_price(best_bid_price) && book.asks.best_price(best_ask_price)
-               && best_bid_price >= best_ask_price) {
-
-            uint32_t bid_px, ask_px;
-            Order* bid_o = book.bids.best_order(bid_px);
-            Order* ask_o = book.asks.best_order(ask_px);
-            if (!bid_o || !ask_o) {break;}
-
-            const uint32_t trade_qty = (bid_o->qty < ask_o->qty) ? bid_o->qty : ask_o->qty;
-            const uint32_t trade_px = (msg.side == Order_Type::Buy) ? ask_px : bid_px;
-
-            TradeMsg wire{
-                bid_o->order_id,
-                ask_o->order_id,
-                trade_px,
-                trade_qty
-            };
-            TradeMsg out{
-                htonl(wire.bid_order_id),
-                htonl(wire.ask_order_id),
-                htonl(wire.price_tick),
-                htonl(wire.qty)
-            };
-            sendto(trade_fd, &out, sizeof(out), 0,
-                reinterpret_cast<sockaddr*>(&trade_addr), sizeof(trade_addr));
-
-            bid_o->qty -= trade_qty;
-            ask_o->qty -= trade_qty;
-            if (bid_o->qty == 0) { book.bids.remove_best(bid_px); }
-            if (ask_o->qty == 0) { book.asks.remove_best(ask_px); }
+        for (uint32_t m{}; m < count; m++) {
+            const OrderMsg& msg = msgs[m];
+
+            switch (msg.msg_type) {
+                case MsgType::NewLimit:
+                    if (msg.side == Order_Type::Buy) {
+                        book.bids.on_new_limit(msg.order_id, msg.price_tick, msg.qty);
+                    } 
+                    else {
+                        book.asks.on_new_limit(msg.order_id, msg.price_tick, msg.qty);
+                    }
+                    break;
+                case MsgType::Cancel:
+                    if (msg.side == Order_Type::Buy) {
+                        book.bids.on_cancel(msg.order_id);
+                    } 
+                    else {
+                        book.asks.on_cancel(msg.order_id);
+                    }
+                    break;
+                case MsgType::Modify:
+                    if (msg.side == Order_Type::Buy) {
+                        book.bids.on_modify(msg.order_id, msg.price_tick, msg.qty);
+                    } 
+                    else {
+                        book.asks.on_modify(msg.order_id, msg.price_tick, msg.qty);
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            uint32_t best_bid_price, best_ask_price;
+            while (book.bids.best_price(best_bid_price) && book.asks.best_price(best_ask_price)
+                   && best_bid_price >= best_ask_price) {
+
+                uint32_t bid_px, ask_px;
+                const Order* bid_o = book.bids.best_order(bid_px);
+                const Order* ask_o = book.asks.best_order(ask_px);
+                if (!bid_o || !ask_o) {break;}
+
+                const uint32_t trade_qty = (bid_o->qty < ask_o->qty) ? bid_o->qty : ask_o->qty;
+                const uint32_t trade_px = (msg.side == Order_Type::Buy) ? ask_px : bid_px;
+
+                ReportWire out{};
+                out.order_id = htonl(bid_o->order_id);
+                out.other_id = htonl(ask_o->order_id);
+                out.price_tick = htonl(trade_px);
+                out.qty = htonl(trade_qty);
+                out.type = ExecType::Trade;
+                sendto(trade_fd, &out, sizeof(out), 0,
+                    reinterpret_cast<sockaddr*>(&trade_addr), sizeof(trade_addr));
+
+                book.bids.fill_best(bid_px, trade_qty);
+                book.asks.fill_best(ask_px, trade_qty);
+            }
         }
     }
 
@@ -0,0 +1,722 @@
+// Differential fuzz + throughput check for the book backends. Random order streams run
+// in lockstep through OrderBook<std::map>, VectorOrderBook and a naive reference model;
+// trades must match message by message and the books level by level. Then each real
+// backend is timed on one long stream and compared against a saved baseline.
+// The tombstone (cancel-heavy) vector book keeps arrival order within a level, so it
+// is checked against the reference model with order-preserving cancels instead.
+// Mass cancel is checked against a filtered copy of the book it ran on.
+// The call auction's clearing price and fills are checked against a brute-force
+// search over every price, and its uncross is timed on a 100k-order crossed book.
+//
+// usage: ./book_fuzz [--seed N] [--streams N] [--msgs N] [--baseline FILE]
+//                    [--threshold PCT] [--save]
+// exits 1 on a mismatch, 2 when a backend is more than PCT% under its baseline ops/sec,
+// 3 when --threshold is given but a backend has no baseline to compare with. No baseline
+// is checked in (numbers are per machine): record one first with --save.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "auction.h"
+#include "book_types.h"
+
+using MapBids = OrderBook<Order_Type::Buy, std::map<uint32_t, std::vector<Order>, std::greater<uint32_t>>>;
+using MapAsks = OrderBook<Order_Type::Sell, std::map<uint32_t, std::vector<Order>, std::less<uint32_t>>>;
+
+static constexpr uint32_t CHECK_EVERY = 256;      // full book compare interval, trades every msg
+static constexpr uint32_t BENCH_MSGS = 250'000; // at most 70% new, stays under MAX_ORDER_ID
+static constexpr int BENCH_RUNS = 7;
+static constexpr uint32_t CANCEL_MSGS = 1'000'000; // 10% new in the cancel-heavy replay
+static constexpr uint32_t AUCTION_ORDERS = 100'000; // resting orders in the timed uncross
+
+static uint64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Reference side: deliberately naive, linear searches everywhere. It spells out the
+// semantics the real books have today so a change to them has to be made here too:
+// best level first, back of the level first within it, a cancel moves the level's
+// last order into the hole, a same-price modify keeps its place. Ordered = true is
+// the tombstone book's semantics: a cancel closes the hole and keeps arrival order.
+template <Order_Type Side, bool Ordered = false>
+class RefBook {
+    struct Level {
+        uint32_t price;
+        std::vector<Order> orders;
+    };
+    std::vector<Level> levels_; // unsorted
+
+    bool better(uint32_t a, uint32_t b) const {
+        return (Side == Order_Type::Buy) ? a > b : a < b;
+    }
+
+    int best_level() const {
+        int best = -1;
+        for (size_t i{}; i < levels_.size(); i++) {
+            if (best < 0 || better(levels_[i].price, levels_[(size_t)best].price)) { best = (int)i; }
+        }
+        return best;
+    }
+
+    bool find(uint32_t order_id, size_t& lvl, size_t& pos) const {
+        for (lvl = 0; lvl < levels_.size(); lvl++) {
+            for (pos = 0; pos < levels_[lvl].orders.size(); pos++) {
+                if (levels_[lvl].orders[pos].order_id == order_id) { return true; }
+            }
+        }
+        return false;
+    }
+
+public:
+    bool accepts(uint32_t order_id, uint32_t price_tick) const {
+        return order_id <= MAX_ORDER_ID && price_tick >= PRICE_MIN && price_tick <= PRICE_MAX;
+    }
+
+    bool order_price(uint32_t order_id, uint32_t& out) const {
+        size_t l, p;
+        if (!find(order_id, l, p)) { return false; }
+        out = levels_[l].price;
+        return true;
+    }
+
+    void on_new_limit(uint32_t order_id, uint32_t price_tick, uint32_t qty) {
+        for (Level& l : levels_) {
+            if (l.price == price_tick) {
+                l.orders.push_back(Order{order_id, qty});
+                return;
+            }
+        }
+        levels_.push_back(Level{price_tick, {Order{order_id, qty}}});
+    }
+
+    void on_cancel(uint32_t order_id) {
+        size_t l, p;
+        if (!find(order_id, l, p)) { return; }
+        auto& orders = levels_[l].orders;
+        if (Ordered) {
+            orders.erase(orders.begin() + (long)p);
+        } else {
+            orders[p] = orders.back();
+            orders.pop_back();
+        }
+        if (orders.empty()) { levels_.erase(levels_.begin() + (long)l); }
+    }
+
+    void on_modify(uint32_t order_id, uint32_t price_tick, uint32_t qty) {
+        size_t l, p;
+        if (!find(order_id, l, p)) { return; }
+        if (levels_[l].price == price_tick) {
+            levels_[l].orders[p].qty = qty;
+            return;
+        }
+        on_cancel(order_id);
+        on_new_limit(order_id, price_tick, qty);
+    }
+
+    template <typename OnFill>
+    uint32_t sweep(uint32_t limit_price, uint32_t qty, OnFill&& on_fill) {
+        while (qty > 0) {
+            const int b = best_level();
+            if (b < 0 || better(limit_price, levels_[(size_t)b].price)) { break; }
+            Level& l = levels_[(size_t)b];
+            Order& o = l.orders.back();
+            const uint32_t f = std::min(o.qty, qty);
+            on_fill(o.order_id, l.price, f);
+            o.qty -= f;
+            qty -= f;
+            if (o.qty == 0) {
+                l.orders.pop_back();
+                if (l.orders.empty()) { levels_.erase(levels_.begin() + b); }
+            }
+        }
+        return qty;
+    }
+
+    const std::vector<Level>& levels() const { return levels_; }
+};
+
+struct Fill {
+    uint32_t bid, ask, px, qty;
+    bool operator==(const Fill& o) const {
+        return bid == o.bid && ask == o.ask && px == o.px && qty == o.qty;
+    }
+};
+
+// one resting order as a book stores it, in priority order of its side
+struct Resting {
+    uint32_t px, order_id, qty;
+    bool operator==(const Resting& o) const {
+        return px == o.px && order_id == o.order_id && qty == o.qty;
+    }
+};
+
+// The crossing logic of Matcher without risk, reports or stops, over any book pair
+template <typename Bids, typename Asks>
+struct Exchange {
+    Bids bids;
+    Asks asks;
+    std::vector<Fill> fills; // from the last message
+
+    template <typename Own, typename Opp>
+    void cross_and_rest(Own& own, Opp& opp, const OrderMsg& m) {
+        const bool buy = (m.side == Order_Type::Buy);
+        const uint32_t left = opp.sweep(m.price_tick, m.qty, [&](uint32_t resting, uint32_t px, uint32_t q) {
+            fills.push_back(buy ? Fill{m.order_id, resting, px, q} : Fill{resting, m.order_id, px, q});
+        });
+        if (left) { own.on_new_limit(m.order_id, m.price_tick, left); }
+    }
+
+    template <typename Own, typename Opp>
+    void handle(Own& own, Opp& opp, const OrderMsg& m) {
+        uint32_t px;
+        switch (m.msg_type) {
+            case MsgType::NewLimit:
+                if (own.accepts(m.order_id, m.price_tick)) { cross_and_rest(own, opp, m); }
+                break;
+            case MsgType::Cancel:
+                own.on_cancel(m.order_id);
+                break;
+            case MsgType::Modify:
+                if (!own.order_price(m.order_id, px)) { break; }
+                if (px == m.price_tick) {
+                    own.on_modify(m.order_id, m.price_tick, m.qty);
+                    break;
+                }
+                own.on_cancel(m.order_id);
+                if (own.accepts(m.order_id, m.price_tick)) { cross_and_rest(own, opp, m); }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void on_msg(const OrderMsg& m) {
+        fills.clear();
+        if (m.side == Order_Type::Buy) { handle(bids, asks, m); }
+        else { handle(asks, bids, m); }
+    }
+};
+
+// book contents best level first, each level in storage order (which decides priority),
+// tombstones left out
+template <Order_Type T, typename C>
+static std::vector<Resting> dump(const OrderBook<T, C>& b) {
+    std::vector<Resting> out;
+    for (const auto& [px, level] : b.raw_levels()) {
+        for (const Order& o : level) { out.push_back(Resting{px, o.order_id, o.qty}); }
+    }
+    return out;
+}
+
+template <Order_Type T, uint32_t Lo, uint32_t Hi, uint32_t Ids, bool Tomb>
+static std::vector<Resting> dump(const VectorOrderBook<T, Lo, Hi, Ids, Tomb>& b) {
+    std::vector<Resting> out;
+    const auto& levels = b.raw_levels();
+    for (uint32_t k{}; k < levels.size(); k++) {
+        const uint32_t i = (T == Order_Type::Buy) ? (uint32_t)levels.size() - 1 - k : k;
+        for (const Order& o : levels[i].orders) {
+            if (o.qty != 0) { out.push_back(Resting{Lo + i, o.order_id, o.qty}); }
+        }
+    }
+    return out;
+}
+
+template <Order_Type T, bool Ordered>
+static std::vector<Resting> dump(const RefBook<T, Ordered>& b) {
+    auto levels = b.levels();
+    std::sort(levels.begin(), levels.end(), [](const auto& a, const auto& c) {
+        return (T == Order_Type::Buy) ? a.price > c.price : a.price < c.price;
+    });
+    std::vector<Resting> out;
+    for (const auto& l : levels) {
+        for (const Order& o : l.orders) { out.push_back(Resting{l.price, o.order_id, o.qty}); }
+    }
+    return out;
+}
+
+// the vector book's per-level aggregates have to agree with its own orders
+template <Order_Type T, uint32_t Lo, uint32_t Hi, uint32_t Ids, bool Tomb>
+static bool aggregates_ok(const VectorOrderBook<T, Lo, Hi, Ids, Tomb>& b, uint32_t& bad_px) {
+    const auto& levels = b.raw_levels();
+    for (uint32_t i{}; i < levels.size(); i++) {
+        uint64_t qty = 0;
+        uint32_t live = 0;
+        for (const Order& o : levels[i].orders) {
+            qty += o.qty;
+            live += (o.qty != 0);
+        }
+        if (b.level_qty(Lo + i) != qty || b.level_count(Lo + i) != live) {
+            bad_px = Lo + i;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stream shape varies per seed: price band width (narrow = lots of crossing, wide =
+// deep books), message mix, and occasional large sweeping orders. pct_new < 0 takes
+// the mix from the seed too, otherwise the rest after new and cancel is modifies.
+static std::vector<OrderMsg> make_stream(uint64_t seed, uint32_t n, int pct_new = -1,
+                                         int pct_cancel = 0) {
+    std::mt19937_64 rng(seed);
+    const int band = 2 + (int)(rng() % 60);
+    if (pct_new < 0) {
+        pct_new = 30 + (int)(rng() % 40);
+        pct_cancel = (int)(rng() % (100 - pct_new));
+    }
+    std::uniform_int_distribution<int> delta(-band, band);
+    std::vector<std::pair<uint32_t, Order_Type>> ids; // issued ids, live or not
+    std::vector<OrderMsg> out;
+    out.reserve(n);
+    uint32_t mid = 10000;
+    for (uint32_t i{}; i < n; i++) {
+        OrderMsg m{};
+        m.seq_num = i + 1;
+        m.qty = (rng() % 50 == 0) ? 200 + (uint32_t)(rng() % 2000) : 1 + (uint32_t)(rng() % 100);
+        if (rng() % 1000 == 0) { mid = 9000 + (uint32_t)(rng() % 2000); } // regime shift
+        m.price_tick = (uint32_t)((int)mid + delta(rng));
+        const int k = (int)(rng() % 100);
+        if ((k < pct_new || ids.empty()) && ids.size() < MAX_ORDER_ID) {
+            m.msg_type = MsgType::NewLimit;
+            m.side = (rng() & 1) ? Order_Type::Buy : Order_Type::Sell;
+            m.order_id = (uint32_t)ids.size() + 1;
+            ids.emplace_back(m.order_id, m.side);
+        }
+        else {
+            // mostly recent ids so cancels and modifies usually hit live orders
+            const size_t back = (rng() & 1) ? rng() % std::min<size_t>(ids.size(), 64) : rng() % ids.size();
+            const auto& [id, side] = ids[ids.size() - 1 - back];
+            m.order_id = id;
+            m.side = (rng() % 20 == 0) ? (side == Order_Type::Buy ? Order_Type::Sell : Order_Type::Buy) : side;
+            m.msg_type = (k < pct_new + pct_cancel) ? MsgType::Cancel : MsgType::Modify;
+        }
+        out.push_back(m);
+    }
+    return out;
+}
+
+static void print_fills(const char* name, const std::vector<Fill>& f) {
+    std::fprintf(stderr, "  %-6s", name);
+    for (const Fill& x : f) { std::fprintf(stderr, " (%u,%u,%u@%u)", x.bid, x.ask, x.qty, x.px); }
+    std::fprintf(stderr, "\n");
+}
+
+static const char* msg_name(MsgType t) {
+    switch (t) {
+        case MsgType::NewLimit: return "new";
+        case MsgType::Cancel: return "cancel";
+        case MsgType::Modify: return "modify";
+        default: return "other";
+    }
+}
+
+template <typename A, typename B>
+static bool same_books(const char* what, const A& a, const B& b, uint64_t seed, uint32_t i) {
+    const auto da = dump(a);
+    const auto db = dump(b);
+    if (da == db) { return true; }
+    size_t k = 0;
+    while (k < da.size() && k < db.size() && da[k] == db[k]) { k++; }
+    std::fprintf(stderr, "seed %lu msg %u: %s books differ at entry %zu (sizes %zu vs %zu)\n",
+                 (unsigned long)seed, i, what, k, da.size(), db.size());
+    return false;
+}
+
+using RefEx = Exchange<RefBook<Order_Type::Buy>, RefBook<Order_Type::Sell>>;
+using MapEx = Exchange<MapBids, MapAsks>;
+using VecEx = Exchange<VectorOrderBook<Order_Type::Buy, PRICE_MIN, PRICE_MAX, MAX_ORDER_ID, false>,
+                       VectorOrderBook<Order_Type::Sell, PRICE_MIN, PRICE_MAX, MAX_ORDER_ID, false>>;
+using RefOrderedEx = Exchange<RefBook<Order_Type::Buy, true>, RefBook<Order_Type::Sell, true>>;
+using TombEx = Exchange<VectorOrderBook<Order_Type::Buy, PRICE_MIN, PRICE_MAX, MAX_ORDER_ID, true>,
+                        VectorOrderBook<Order_Type::Sell, PRICE_MIN, PRICE_MAX, MAX_ORDER_ID, true>>;
+
+static bool fuzz_one(uint64_t seed, uint32_t n) {
+    const auto msgs = make_stream(seed, n);
+    auto ref = std::make_unique<RefEx>();
+    auto map = std::make_unique<MapEx>();
+    auto vec = std::make_unique<VecEx>();
+    auto ref_ordered = std::make_unique<RefOrderedEx>();
+    auto tomb = std::make_unique<TombEx>();
+    for (uint32_t i{}; i < msgs.size(); i++) {
+        const OrderMsg& m = msgs[i];
+        ref->on_msg(m);
+        map->on_msg(m);
+        vec->on_msg(m);
+        ref_ordered->on_msg(m);
+        tomb->on_msg(m);
+        if (i % 7 == 0) { // stand-in for idle time between bursts
+            tomb->bids.compact_some(1);
+            tomb->asks.compact_some(1);
+        }
+        if (!(ref_ordered->fills == tomb->fills)) {
+            std::fprintf(stderr, "seed %lu msg %u: tombstone trades differ on %s id %u\n",
+                         (unsigned long)seed, i, msg_name(m.msg_type), m.order_id);
+            print_fills("ref", ref_ordered->fills);
+            print_fills("tomb", tomb->fills);
+            return false;
+        }
+        if (!(ref->fills == map->fills) || !(ref->fills == vec->fills)) {
+            std::fprintf(stderr, "seed %lu msg %u: trades differ on %s id %u px %u qty %u %s\n",
+                         (unsigned long)seed, i, msg_name(m.msg_type), m.order_id, m.price_tick,
+                         m.qty, m.side == Order_Type::Buy ? "buy" : "sell");
+            print_fills("ref", ref->fills);
+            print_fills("map", map->fills);
+            print_fills("vector", vec->fills);
+            return false;
+        }
+        if (i % CHECK_EVERY == 0 || i + 1 == msgs.size()) {
+            if (!same_books("map bid", ref->bids, map->bids, seed, i) ||
+                !same_books("map ask", ref->asks, map->asks, seed, i) ||
+                !same_books("vector bid", ref->bids, vec->bids, seed, i) ||
+                !same_books("vector ask", ref->asks, vec->asks, seed, i) ||
+                !same_books("tombstone bid", ref_ordered->bids, tomb->bids, seed, i) ||
+                !same_books("tombstone ask", ref_ordered->asks, tomb->asks, seed, i)) {
+                return false;
+            }
+            uint32_t px;
+            if (!aggregates_ok(vec->bids, px) || !aggregates_ok(vec->asks, px) ||
+                !aggregates_ok(tomb->bids, px) || !aggregates_ok(tomb->asks, px)) {
+                std::fprintf(stderr, "seed %lu msg %u: vector level aggregates wrong at px %u\n",
+                             (unsigned long)seed, i, px);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// One mass cancel against a filtered copy of the book: a random id subset (standing
+// in for a session) within a random price range comes out, everything else keeps its
+// place, and the count, aggregates and best price follow.
+template <typename Book>
+static bool mass_cancel_ok(Book& b, std::mt19937_64& rng, const char* what, uint64_t seed) {
+    const uint32_t lo = (rng() % 4 == 0) ? PRICE_MIN : 8900 + (uint32_t)(rng() % 2200);
+    const uint32_t hi = (rng() % 4 == 0) ? PRICE_MAX : lo + (uint32_t)(rng() % 400);
+    const uint32_t mod = 1 + (uint32_t)(rng() % 4);
+    const uint32_t rem = (uint32_t)(rng() % mod);
+    auto match = [&](uint32_t id) { return id % mod == rem; };
+    const auto before = dump(b);
+    std::vector<Resting> want;
+    for (const Resting& r : before) {
+        if (r.px < lo || r.px > hi || !match(r.order_id)) { want.push_back(r); }
+    }
+    uint32_t calls = 0;
+    const uint32_t n = b.cancel_where(lo, hi, match, [&](uint32_t) { ++calls; });
+    uint32_t best = 0, bad_px = 0;
+    const bool has_best = b.best_price(best);
+    const bool best_ok = want.empty() ? !has_best : (has_best && best == want[0].px);
+    if (!(dump(b) == want) || n != calls || n != before.size() - want.size() || !best_ok ||
+        !aggregates_ok(b, bad_px)) {
+        std::fprintf(stderr, "seed %lu: %s mass cancel %u..%u id %% %u == %u wrong (removed %u of %zu)\n",
+                     (unsigned long)seed, what, lo, hi, mod, rem, n, before.size() - want.size());
+        return false;
+    }
+    return true;
+}
+
+static bool mass_cancel_one(uint64_t seed, uint32_t n) {
+    const auto msgs = make_stream(seed, n);
+    auto vec = std::make_unique<VecEx>();
+    auto tomb = std::make_unique<TombEx>();
+    for (const OrderMsg& m : msgs) {
+        vec->on_msg(m);
+        tomb->on_msg(m);
+    }
+    std::mt19937_64 rng(seed);
+    for (int k = 0; k < 3; k++) { // later passes see the state earlier ones left
+        if (!mass_cancel_ok(vec->bids, rng, "vector bid", seed) ||
+            !mass_cancel_ok(vec->asks, rng, "vector ask", seed) ||
+            !mass_cancel_ok(tomb->bids, rng, "tombstone bid", seed) ||
+            !mass_cancel_ok(tomb->asks, rng, "tombstone ask", seed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+using AuctionBids = VectorOrderBook<Order_Type::Buy, PRICE_MIN, PRICE_MAX, MAX_ORDER_ID, CANCEL_TOMBSTONES>;
+using AuctionAsks = VectorOrderBook<Order_Type::Sell, PRICE_MIN, PRICE_MAX, MAX_ORDER_ID, CANCEL_TOMBSTONES>;
+
+struct AuctionBooks {
+    AuctionBids bids;
+    AuctionAsks asks;
+    std::vector<OrderMsg> orders; // what was added, for the brute-force check
+};
+
+// n orders in overlapping bands around 10000 so the books cross deeply, both sides
+// accumulating; id 1..n
+static std::unique_ptr<AuctionBooks> crossed_books(uint64_t seed, uint32_t n, uint32_t band) {
+    auto b = std::make_unique<AuctionBooks>();
+    b->bids.set_accumulate(true);
+    b->asks.set_accumulate(true);
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<uint32_t> px(10000 - band, 10000 + band);
+    std::uniform_int_distribution<uint32_t> qty(1, 100);
+    b->orders.reserve(n);
+    for (uint32_t id = 1; id <= n; id++) {
+        OrderMsg m{};
+        m.order_id = id;
+        m.side = (rng() & 1) ? Order_Type::Buy : Order_Type::Sell;
+        m.price_tick = px(rng);
+        m.qty = qty(rng);
+        if (m.side == Order_Type::Buy) { b->bids.on_new_limit(id, m.price_tick, m.qty); }
+        else { b->asks.on_new_limit(id, m.price_tick, m.qty); }
+        b->orders.push_back(m);
+    }
+    return b;
+}
+
+// Every price, straight off the order list, same tie-breaks as CallAuction
+static AuctionResult brute_force_clearing(const std::vector<OrderMsg>& orders, uint32_t ref_px) {
+    uint32_t hi = 0, lo = UINT32_MAX;
+    for (const OrderMsg& m : orders) {
+        if (m.side == Order_Type::Buy) { hi = std::max(hi, m.price_tick); }
+        else { lo = std::min(lo, m.price_tick); }
+    }
+    AuctionResult best{0, 0, 0, 0};
+    if (hi == 0 || lo == UINT32_MAX || hi < lo) { return best; }
+    if (ref_px == 0) { ref_px = lo + (hi - lo) / 2; }
+    uint64_t best_imb = 0;
+    uint32_t best_dist = 0;
+    for (uint32_t p = PRICE_MIN; p <= PRICE_MAX; p++) {
+        uint64_t d = 0, s = 0;
+        for (const OrderMsg& m : orders) {
+            if (m.side == Order_Type::Buy && m.price_tick >= p) { d += m.qty; }
+            if (m.side == Order_Type::Sell && m.price_tick <= p) { s += m.qty; }
+        }
+        const uint64_t vol = std::min(d, s);
+        const uint64_t imb = (d < s) ? s - d : d - s;
+        const uint32_t dist = (p > ref_px) ? p - ref_px : ref_px - p;
+        if (vol > best.volume || (vol != 0 && vol == best.volume && (imb < best_imb ||
+                (imb == best_imb && dist < best_dist)))) {
+            best = AuctionResult{p, vol, d, s};
+            best_imb = imb;
+            best_dist = dist;
+        }
+    }
+    return best;
+}
+
+static bool auction_one(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    const uint32_t n = 1 + (uint32_t)(rng() % 400);
+    const uint32_t band = 1 + (uint32_t)(rng() % 40);
+    const uint32_t ref_px = (rng() % 2) ? 0 : 10000 - 50 + (uint32_t)(rng() % 100);
+    auto b = crossed_books(seed, n, band);
+    const AuctionResult want = brute_force_clearing(b->orders, ref_px);
+    CallAuction auction(PRICE_MAX - PRICE_MIN + 1);
+    AuctionResult got{0, 0, 0, 0};
+    auction.clearing_price(b->bids, b->asks, ref_px, got);
+    if (got.volume != want.volume || (want.volume != 0 && got.price_tick != want.price_tick)) {
+        std::fprintf(stderr, "seed %lu: auction clears %lu @ %u, brute force %lu @ %u\n",
+                     (unsigned long)seed, (unsigned long)got.volume, got.price_tick,
+                     (unsigned long)want.volume, want.price_tick);
+        return false;
+    }
+    std::vector<uint32_t> filled(n + 1);
+    uint64_t traded = 0;
+    bool bad_px = false;
+    auction.uncross(b->bids, b->asks, ref_px, [&](uint32_t bid, uint32_t ask, uint32_t px, uint32_t q) {
+        filled[bid] += q;
+        filled[ask] += q;
+        traded += q;
+        bad_px |= (px != want.price_tick);
+    });
+    bool over = false;
+    for (const OrderMsg& m : b->orders) {
+        over |= filled[m.order_id] > m.qty;
+        // only orders at or through the clearing price can trade
+        if (filled[m.order_id] != 0) {
+            over |= (m.side == Order_Type::Buy) ? m.price_tick < want.price_tick
+                                                : m.price_tick > want.price_tick;
+        }
+    }
+    uint32_t bb, ba, px;
+    const bool crossed = b->bids.best_price(bb) && b->asks.best_price(ba) && bb >= ba;
+    if (traded != want.volume || bad_px || over || crossed ||
+        !aggregates_ok(b->bids, px) || !aggregates_ok(b->asks, px)) {
+        std::fprintf(stderr, "seed %lu: uncross traded %lu of %lu%s%s%s\n", (unsigned long)seed,
+                     (unsigned long)traded, (unsigned long)want.volume, bad_px ? ", off price" : "",
+                     over ? ", overfilled" : "", crossed ? ", book still crossed" : "");
+        return false;
+    }
+    return true;
+}
+
+// best-of-N orders/sec through a 100k-order uncross, trades counted not reported
+static double auction_orders_per_sec(uint64_t seed, uint64_t& trades, double& best_us) {
+    double best = 0;
+    best_us = 0;
+    CallAuction auction(PRICE_MAX - PRICE_MIN + 1);
+    for (int r{}; r < BENCH_RUNS; r++) {
+        auto b = crossed_books(seed, AUCTION_ORDERS, 50);
+        uint64_t t = 0;
+        const uint64_t start = now_ns();
+        auction.uncross(b->bids, b->asks, 0, [&](uint32_t, uint32_t, uint32_t, uint32_t) { ++t; });
+        const uint64_t ns = now_ns() - start;
+        const double ops = AUCTION_ORDERS * 1e9 / (double)ns;
+        if (ops > best) {
+            best = ops;
+            best_us = ns / 1e3;
+        }
+        trades = t;
+    }
+    return best;
+}
+
+// best-of-N ops/sec for one backend over the whole stream
+template <typename Ex>
+static double ops_per_sec(const std::vector<OrderMsg>& msgs, uint64_t& fills) {
+    double best = 0;
+    for (int r{}; r < BENCH_RUNS; r++) {
+        auto ex = std::make_unique<Ex>();
+        uint64_t f = 0;
+        const uint64_t start = now_ns();
+        for (const OrderMsg& m : msgs) {
+            ex->on_msg(m);
+            f += ex->fills.size();
+        }
+        const double ops = msgs.size() * 1e9 / (double)(now_ns() - start);
+        if (ops > best) { best = ops; }
+        fills = f;
+    }
+    return best;
+}
+
+// baseline file: one "backend,ops_per_sec" line per backend
+static std::map<std::string, double> load_baseline(const std::string& path) {
+    std::map<std::string, double> out;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t c = line.find(',');
+        if (c == std::string::npos) { continue; }
+        out[line.substr(0, c)] = std::atof(line.c_str() + c + 1);
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    uint64_t seed = 1;
+    uint32_t streams = 200;
+    uint32_t msgs = 20'000;
+    double threshold = 15.0; // bench noise on a shared VM is around +-10%
+    bool save = false;
+    bool strict = false; // --threshold given: a missing baseline is a failure, not a note
+    std::string baseline = "data/book_fuzz_baseline.csv";
+    for (int i = 1; i < argc; i++) {
+        const bool has_val = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--seed") && has_val) { seed = std::strtoull(argv[++i], nullptr, 10); }
+        else if (!std::strcmp(argv[i], "--streams") && has_val) { streams = (uint32_t)std::atoi(argv[++i]); }
+        else if (!std::strcmp(argv[i], "--msgs") && has_val) { msgs = (uint32_t)std::atoi(argv[++i]); }
+        else if (!std::strcmp(argv[i], "--baseline") && has_val) { baseline = argv[++i]; }
+        else if (!std::strcmp(argv[i], "--threshold") && has_val) {
+            threshold = std::atof(argv[++i]);
+            strict = true;
+        }
+        else if (!std::strcmp(argv[i], "--save")) { save = true; }
+        else {
+            std::fprintf(stderr, "usage: %s [--seed N] [--streams N] [--msgs N] [--baseline FILE] "
+                         "[--threshold PCT] [--save]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (uint32_t s{}; s < streams; s++) {
+        if (!fuzz_one(seed + s, msgs)) {
+            std::fprintf(stderr, "FAIL: rerun with --seed %lu --streams 1\n", (unsigned long)(seed + s));
+            return 1;
+        }
+    }
+    std::printf("fuzz: %u streams x %u msgs, ref/map/vector and ref/tombstone agree\n",
+                streams, msgs);
+    for (uint32_t s{}; s < streams; s++) {
+        if (!mass_cancel_one(seed + s, msgs)) {
+            std::fprintf(stderr, "FAIL: mass cancel, rerun with --seed %lu --streams 1\n",
+                         (unsigned long)(seed + s));
+            return 1;
+        }
+    }
+    std::printf("mass cancel: %u books, bitmap walk matches a filtered copy\n", streams);
+    for (uint32_t s{}; s < streams; s++) {
+        if (!auction_one(seed + s)) {
+            std::fprintf(stderr, "FAIL: auction, rerun with --seed %lu --streams 1\n",
+                         (unsigned long)(seed + s));
+            return 1;
+        }
+    }
+    std::printf("auction: %u crossed books, clearing price and fills match brute force\n", streams);
+
+    const auto bench = make_stream(seed, BENCH_MSGS);
+    uint64_t map_fills = 0, vec_fills = 0;
+    const double map_ops = ops_per_sec<MapEx>(bench, map_fills);
+    const double vec_ops = ops_per_sec<VecEx>(bench, vec_fills);
+    if (map_fills != vec_fills) {
+        std::fprintf(stderr, "FAIL: bench stream fills differ (map %lu, vector %lu)\n",
+                     (unsigned long)map_fills, (unsigned long)vec_fills);
+        return 1;
+    }
+    uint64_t tomb_fills = 0;
+    const double tomb_ops = ops_per_sec<TombEx>(bench, tomb_fills);
+    std::printf("bench: %u msgs, %lu fills\n", BENCH_MSGS, (unsigned long)vec_fills);
+
+    // cancel-dominated replay: 10% new, 60% cancel, 30% modify
+    const auto cancels = make_stream(seed, CANCEL_MSGS, 10, 60);
+    const double vec_cancel_ops = ops_per_sec<VecEx>(cancels, vec_fills);
+    const double tomb_cancel_ops = ops_per_sec<TombEx>(cancels, tomb_fills);
+    std::printf("cancel-heavy: %u msgs\n", CANCEL_MSGS);
+
+    uint64_t auction_trades = 0;
+    double auction_us = 0;
+    const double auction_ops = auction_orders_per_sec(seed, auction_trades, auction_us);
+    std::printf("uncross: %u orders, %lu trades in %.0f us\n", AUCTION_ORDERS,
+                (unsigned long)auction_trades, auction_us);
+
+    const std::pair<const char*, double> results[] = {
+        {"map", map_ops}, {"vector", vec_ops}, {"tomb", tomb_ops},
+        {"vector_cx", vec_cancel_ops}, {"tomb_cx", tomb_cancel_ops}, {"auction", auction_ops}};
+    const auto base = load_baseline(baseline);
+    int rc = 0;
+    uint32_t missing = 0;
+    for (const auto& [name, ops] : results) {
+        auto it = base.find(name);
+        if (it == base.end() || it->second <= 0) {
+            std::printf("  %-9s %12.0f ops/s  (no baseline)\n", name, ops);
+            ++missing;
+            continue;
+        }
+        const double change = (ops / it->second - 1.0) * 100.0;
+        const bool regressed = change < -threshold;
+        std::printf("  %-9s %12.0f ops/s  baseline %12.0f  %+6.1f%%%s\n", name, ops, it->second,
+                    change, regressed ? "  REGRESSED" : "");
+        if (regressed) { rc = 2; }
+    }
+    if (missing != 0 && !save) {
+        std::fprintf(stderr, "warning: %u backends have no baseline in %s, nothing was checked "
+                     "for them; record one with --save\n", missing, baseline.c_str());
+        if (strict && rc == 0) { rc = 3; }
+    }
+    if (save) {
+        const auto dir = std::filesystem::path(baseline).parent_path();
+        std::error_code ec;
+        if (!dir.empty()) { std::filesystem::create_directories(dir, ec); } // data/ isn't checked in
+        std::ofstream out(baseline, std::ios::trunc);
+        if (!out) {
+            std::perror(baseline.c_str());
+            return 1;
+        }
+        for (const auto& [name, ops] : results) { out << name << "," << (uint64_t)ops << "\n"; }
+        std::printf("saved baseline to %s\n", baseline.c_str());
+    }
+    return rc;
+}
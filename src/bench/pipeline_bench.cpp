@@ -0,0 +1,358 @@
+// Three-thread pipeline vs run-to-completion, fed the same synthetic RX frames at
+// fixed offered rates. Message i "arrives" at t0 + i/rate; its latency runs from
+// then until its ack or reject is ready to go on the wire (popped by the report
+// sender, or pushed to the batcher inline). Reports are not actually sent, so
+// both layouts skip the same sendto. Past the rate a layout can sustain, the
+// latency is mostly queueing and the achieved rate shows where that is.
+//
+// usage: ./pipeline_bench [--msgs N] [--rates r1,r2,...] [--cpus a,b,c] [--replica]
+//   rates in msgs/s, 0 = as fast as possible; cpus for recv, matcher and sender
+//   (run-to-completion uses the first). Needs 3 free cores for the three-thread numbers.
+//   --replica runs each layout again journaling for a standby (replica.h), to see what it costs.
+// Before timing anything it checks that malformed v1/v2 frames yield no messages.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "inline_match.h"
+
+static constexpr uint32_t FRAME_HEADROOM = 64; // XDP metadata goes here, left 0 (no rx_ns)
+static constexpr uint32_t FRAME_STRIDE = FRAME_HEADROOM + 64; // one v1 Packet per frame
+static constexpr uint32_t BATCH = 64;          // RX descriptors per peek, as in xdp_recv
+static constexpr uint16_t UDP_PORT = 9000;
+static constexpr const char* BENCH_REPLICA_SHM = "/order_matcher_replica_bench";
+
+static uint64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void pin(int cpu) {
+    if (cpu < 0) { return; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        std::fprintf(stderr, "pin to cpu %d failed\n", cpu);
+    }
+}
+
+// eth/ip/udp headers for a payload of len bytes from 10.0.0.1:40000
+static void write_headers(uint8_t* frame, uint32_t len) {
+    auto* eth = reinterpret_cast<ethhdr*>(frame);
+    auto* ip = reinterpret_cast<iphdr*>(frame + sizeof(ethhdr));
+    auto* udp = reinterpret_cast<udphdr*>(frame + sizeof(ethhdr) + sizeof(iphdr));
+    eth->h_proto = htons(ETH_P_IP);
+    ip->ihl = 5;
+    ip->protocol = IPPROTO_UDP;
+    ip->saddr = htonl(0x0a000001);
+    udp->source = htons(40000);
+    udp->dest = htons(UDP_PORT);
+    udp->len = htons(sizeof(udphdr) + len);
+}
+
+// new limits around 10000 mixed with cancels and modifies of recent ids, as frames
+struct Frames {
+    std::vector<uint8_t> umem;
+    std::vector<xdp_desc> desc;
+};
+
+static Frames make_frames(uint32_t n) {
+    Frames f;
+    f.umem.assign((size_t)n * FRAME_STRIDE, 0);
+    f.desc.resize(n);
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<int> kind(0, 9);
+    std::uniform_int_distribution<int> price_delta(-10, 10);
+    std::uniform_int_distribution<uint32_t> qty_dist(1, 100);
+    uint32_t next_id = 1;
+    for (uint32_t i{}; i < n; i++) {
+        const uint64_t addr = (uint64_t)i * FRAME_STRIDE + FRAME_HEADROOM;
+        uint8_t* frame = f.umem.data() + addr;
+        write_headers(frame, sizeof(Packet));
+
+        Packet p{};
+        p.seq_num = htonl(i + 1);
+        p.side = (engine() & 1) ? Order_Type::Buy : Order_Type::Sell;
+        p.price_tick = htonl(10000 + price_delta(engine));
+        p.qty = htonl(qty_dist(engine));
+        const int k = kind(engine);
+        if (k < 3 || next_id < 16) {
+            p.msg_type = MsgType::NewLimit;
+            p.order_id = htonl(next_id++);
+        }
+        else {
+            p.msg_type = (k < 7) ? MsgType::Cancel : MsgType::Modify;
+            p.order_id = htonl(next_id - 1 - engine() % 16);
+        }
+        std::memcpy(frame + kPayloadOff, &p, sizeof(p));
+        f.desc[i] = xdp_desc{addr, FRAME_STRIDE - FRAME_HEADROOM, 0};
+    }
+    return f;
+}
+
+// Frames gather_payloads has to drop whole: a v2 batch cut short, v2 counts that
+// don't match the length (0, one too many, over WIRE_V2_MAX_MSGS) and a v1 Packet
+// with a trailing byte. One good v2 batch of 2 goes last as the control.
+static bool check_malformed() {
+    struct Bad {
+        uint8_t count;
+        uint32_t entries; // OrderWires actually in the payload
+        uint32_t extra;   // bytes past them
+        bool v2;
+    };
+    const Bad cases[] = {{3, 2, 0, true}, {3, 2, 10, true}, {0, 1, 0, true}, {2, 1, 0, true},
+                         {WIRE_V2_MAX_MSGS + 1, WIRE_V2_MAX_MSGS + 1, 0, true}, {0, 0, 1, false},
+                         {2, 2, 0, true}};
+    const uint32_t n = sizeof(cases) / sizeof(cases[0]);
+    const uint32_t stride = FRAME_HEADROOM + 2048;
+    std::vector<uint8_t> umem((size_t)n * stride, 0);
+    std::vector<xdp_desc> desc(n);
+    for (uint32_t i{}; i < n; i++) {
+        const Bad& c = cases[i];
+        const uint64_t addr = (uint64_t)i * stride + FRAME_HEADROOM;
+        uint8_t* payload = umem.data() + addr + kPayloadOff;
+        uint32_t len;
+        if (c.v2) {
+            const BatchHeader h{WIRE_V2, c.count, htons(1), htonl(1)};
+            std::memcpy(payload, &h, sizeof(h));
+            for (uint32_t k{}; k < c.entries; k++) {
+                OrderWire w{};
+                w.order_id = htonl(k + 1);
+                w.price_tick = htonl(10000);
+                w.qty = htonl(1);
+                w.msg_type = MsgType::NewLimit;
+                std::memcpy(payload + sizeof(h) + k * sizeof(w), &w, sizeof(w));
+            }
+            len = sizeof(BatchHeader) + c.entries * sizeof(OrderWire) + c.extra;
+        }
+        else {
+            Packet p{};
+            p.seq_num = htonl(1);
+            p.order_id = htonl(1);
+            p.msg_type = MsgType::NewLimit;
+            std::memcpy(payload, &p, sizeof(p));
+            len = sizeof(Packet) + c.extra;
+        }
+        write_headers(umem.data() + addr, len);
+        desc[i] = xdp_desc{addr, kPayloadOff + len, 0};
+    }
+    auto seg = std::make_unique<MetricsSegment>();
+    auto sessions = std::make_unique<SessionTable<UDP_SESSIONS>>();
+    std::vector<RxMsg> msgs(n * RX_MSGS_PER_FRAME);
+    const uint32_t bad = gather_payloads([&](uint32_t i) { return &desc[i]; }, n - 1, umem.data(), UDP_PORT,
+                                         *sessions, msgs.data(), seg->recv);
+    const uint32_t good = gather_payloads([&](uint32_t i) { return &desc[n - 1 + i]; }, 1, umem.data(),
+                                          UDP_PORT, *sessions, msgs.data(), seg->recv);
+    const bool ok = bad == 0 && seg->recv.parse_fail.get() == n - 1 && good == 2 + 1; // + its Bind
+    if (!ok) {
+        std::fprintf(stderr, "malformed frames: %u msgs from %u bad frames (parse_fail %lu), %u from the good one\n",
+                     bad, n - 1, (unsigned long)seg->recv.parse_fail.get(), good);
+    }
+    return ok;
+}
+
+struct RunResult {
+    double achieved;   // msgs/s from first arrival to last ack
+    uint64_t p50, p99, p999, max;
+};
+
+// latency per seq, filled by whoever sees the ack; 0 until then
+struct Latencies {
+    std::vector<uint64_t> due;   // scheduled arrival per seq, index seq - 1
+    std::vector<uint64_t> lat;
+
+    inline void on_report(const ExecReport& r, uint64_t now) {
+        if (r.type == ExecType::Trade || r.client_seq == 0) { return; }
+        lat[r.client_seq - 1] = now - due[r.client_seq - 1];
+    }
+};
+
+static RunResult summarize(Latencies& l, uint64_t t0, uint64_t t_end) {
+    std::vector<uint64_t> v = l.lat;
+    std::sort(v.begin(), v.end());
+    auto pct = [&](double p) { return v[std::min(v.size() - 1, (size_t)(p * v.size()))]; };
+    return RunResult{v.size() * 1e9 / (double)(t_end - t0), pct(0.50), pct(0.99), pct(0.999), v.back()};
+}
+
+// frames whose arrival time has passed, up to BATCH; spins until at least one is due
+static inline uint32_t due_batch(const Latencies& l, uint32_t next, uint32_t n) {
+    const uint64_t now = now_ns();
+    uint32_t k = 0;
+    while (k < BATCH && next + k < n && l.due[next + k] <= now) { ++k; }
+    return k;
+}
+
+static void schedule(Latencies& l, uint32_t n, double rate, uint64_t t0) {
+    l.due.resize(n);
+    l.lat.assign(n, 0);
+    for (uint32_t i{}; i < n; i++) {
+        l.due[i] = t0 + (rate > 0 ? (uint64_t)(i * 1e9 / rate) : 0);
+    }
+}
+
+static std::unique_ptr<ReplicaFeed> make_feed(bool on) {
+    if (!on) { return nullptr; }
+    auto feed = std::make_unique<ReplicaFeed>(BENCH_REPLICA_SHM);
+    if (!feed->on()) { std::exit(1); }
+    return feed;
+}
+
+static RunResult run_inline(const Frames& f, double rate, int cpu, bool journal) {
+    const uint32_t n = (uint32_t)f.desc.size();
+    auto seg = std::make_unique<MetricsSegment>();
+    auto sessions = std::make_unique<SessionTable<UDP_SESSIONS>>();
+    auto feed = make_feed(journal);
+    auto engine = std::make_unique<InlineMatcher>(BATCH + 1, seg->match, nullptr, feed.get());
+    std::vector<RxMsg> msgs(BATCH + 1); // v1 from one source, plus its Bind
+    Latencies l;
+    uint64_t t_end = 0;
+    std::thread t([&]() {
+        pin(cpu);
+        const uint64_t t0 = now_ns() + 1'000'000;
+        schedule(l, n, rate, t0);
+        for (uint32_t next = 0; next < n;) {
+            const uint32_t k = due_batch(l, next, n);
+            if (k == 0) { continue; }
+            const uint32_t m = gather_payloads([&](uint32_t i) { return &f.desc[next + i]; }, k,
+                                               f.umem.data(), UDP_PORT, *sessions, msgs.data(), seg->recv);
+            engine->run(msgs.data(), m, [&](const ExecReport& r) { l.on_report(r, now_ns()); });
+            next += k;
+        }
+        t_end = now_ns();
+    });
+    t.join();
+    return summarize(l, l.due[0], t_end);
+}
+
+static RunResult run_three_thread(const Frames& f, double rate, const int* cpus, bool journal) {
+    const uint32_t n = (uint32_t)f.desc.size();
+    auto seg = std::make_unique<MetricsSegment>();
+    auto sessions = std::make_unique<SessionTable<UDP_SESSIONS>>();
+    auto feed = make_feed(journal);
+    auto ring = std::make_unique<OrderMsgRing>();
+    auto reports = std::make_unique<ReportRing>();
+    std::atomic<bool> running{true};
+    std::atomic<bool> ready{false};
+    Latencies l;
+    uint64_t t_end = 0;
+
+    std::thread matcher([&]() {
+        pin(cpus[1]);
+        match_loop<BusySpinWait>(*ring, *reports, running, seg->match, nullptr, feed.get());
+    });
+    std::thread sender([&]() {
+        pin(cpus[2]);
+        while (!ready.load(std::memory_order_acquire)) { _mm_pause(); }
+        uint32_t acked = 0;
+        while (acked < n) {
+            ExecReport* slot = nullptr;
+            if (!reports->try_acquire_consumer_slot(slot)) { continue; }
+            const uint64_t now = now_ns();
+            if (slot->type != ExecType::Trade) { ++acked; }
+            l.on_report(*slot, now);
+            reports->release_consumer_slot();
+        }
+        t_end = now_ns();
+        running.store(false, std::memory_order_release);
+    });
+    std::thread recv([&]() {
+        pin(cpus[0]);
+        std::vector<RxMsg> msgs(BATCH + 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // matcher builds its books
+        const uint64_t t0 = now_ns() + 1'000'000;
+        schedule(l, n, rate, t0);
+        ready.store(true, std::memory_order_release);
+        for (uint32_t next = 0; next < n;) {
+            const uint32_t k = due_batch(l, next, n);
+            if (k == 0) { continue; }
+            const uint32_t m = gather_payloads([&](uint32_t i) { return &f.desc[next + i]; }, k,
+                                               f.umem.data(), UDP_PORT, *sessions, msgs.data(), seg->recv);
+            while (ring->try_acquire_producer_slots(m) < m) { _mm_pause(); }
+            decode_payloads(msgs.data(), m, *ring);
+            ring->commit_producer_slots(m);
+            next += k;
+        }
+    });
+    recv.join();
+    sender.join();
+    matcher.join();
+    return summarize(l, l.due[0], t_end);
+}
+
+static std::vector<int> parse_list(const char* s) {
+    std::vector<int> out;
+    for (const char* p = s; *p;) {
+        out.push_back(std::atoi(p));
+        const char* c = std::strchr(p, ',');
+        if (!c) { break; }
+        p = c + 1;
+    }
+    return out;
+}
+
+static void print_row(const char* layout, double rate, const RunResult& r) {
+    char offered[32];
+    if (rate > 0) { std::snprintf(offered, sizeof(offered), "%.0f", rate); }
+    else { std::snprintf(offered, sizeof(offered), "max"); }
+    std::printf("%-18s %10s %12.0f %9lu %9lu %9lu %10lu\n", layout, offered, r.achieved,
+                (unsigned long)r.p50, (unsigned long)r.p99, (unsigned long)r.p999, (unsigned long)r.max);
+}
+
+int main(int argc, char** argv) {
+    uint32_t msgs = 200'000; // ~60k new ids, stays under MAX_ORDER_ID
+    std::vector<int> rates = {100'000, 500'000, 1'000'000, 2'000'000, 0};
+    std::vector<int> cpus = {1, 2, 3};
+    bool replica = false;
+    for (int i = 1; i < argc; i++) {
+        const bool has_val = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--msgs") && has_val) { msgs = (uint32_t)std::atoi(argv[++i]); }
+        else if (!std::strcmp(argv[i], "--rates") && has_val) { rates = parse_list(argv[++i]); }
+        else if (!std::strcmp(argv[i], "--cpus") && has_val) { cpus = parse_list(argv[++i]); }
+        else if (!std::strcmp(argv[i], "--replica")) { replica = true; }
+        else {
+            std::fprintf(stderr, "usage: %s [--msgs N] [--rates r1,r2,...] [--cpus a,b,c] [--replica]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+    const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus.resize(3, -1);
+    for (int& c : cpus) {
+        if (c >= ncpu) { c = -1; } // leave unpinned rather than fail
+    }
+    if (ncpu < 3) {
+        std::fprintf(stderr, "only %ld cpus: the three-thread layout will time-share and its numbers "
+                     "mean little\n", ncpu);
+    }
+
+    if (!check_malformed()) { return 1; }
+    const Frames frames = make_frames(msgs);
+    std::printf("%u msgs, latency in ns from scheduled arrival to ack ready to send\n", msgs);
+    std::printf("%-18s %10s %12s %9s %9s %9s %10s\n", "layout", "offered", "achieved", "p50", "p99",
+                "p99.9", "max");
+    for (const int rate : rates) {
+        const RunResult a = run_three_thread(frames, rate, cpus.data(), false);
+        print_row("three-thread", rate, a);
+        const RunResult b = run_inline(frames, rate, cpus[0], false);
+        print_row("run-to-completion", rate, b);
+        if (replica) {
+            print_row("  + journal", rate, run_three_thread(frames, rate, cpus.data(), true));
+            print_row("  + journal", rate, run_inline(frames, rate, cpus[0], true));
+        }
+        std::printf("%-18s %10s lower p99: %s\n", "", "",
+                    b.p99 < a.p99 ? "run-to-completion" : "three-thread");
+    }
+    if (replica) { shm_unlink(BENCH_REPLICA_SHM); }
+    return 0;
+}
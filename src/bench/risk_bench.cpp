@@ -0,0 +1,74 @@
+// Per-order cost of the pre-trade risk gate: the same synthetic stream through
+// BasicMatcher<NoRisk> and BasicMatcher<BookRisk>, best of several runs.
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "matcher.h"
+
+static constexpr uint32_t NUM_MSGS = 600'000; // ~150k new ids, stays under MAX_ORDER_ID
+static constexpr int RUNS = 5;
+
+static uint64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// new limits around 10000 mixed with cancels and modifies of recent ids
+static std::vector<OrderMsg> make_stream(uint32_t n) {
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<int> kind(0, 9);
+    std::uniform_int_distribution<int> price_delta(-10, 10);
+    std::uniform_int_distribution<uint32_t> qty_dist(1, 100);
+    std::vector<OrderMsg> out;
+    out.reserve(n);
+    uint32_t next_id = 1;
+    for (uint32_t i{}; i < n; i++) {
+        OrderMsg m{};
+        m.session = 1; // 0 is CONTROL_SESSION
+        m.seq_num = i + 1;
+        m.side = (engine() & 1) ? Order_Type::Buy : Order_Type::Sell;
+        m.price_tick = 10000 + price_delta(engine);
+        m.qty = qty_dist(engine);
+        const int k = kind(engine);
+        if (k < 3 || next_id < 16) {
+            m.msg_type = MsgType::NewLimit;
+            m.order_id = next_id++;
+        } 
+        else {
+            m.msg_type = (k < 7) ? MsgType::Cancel : MsgType::Modify;
+            m.order_id = next_id - 1 - engine() % 16;
+        }
+        out.push_back(m);
+    }
+    return out;
+}
+
+template <typename Risk>
+static double run(const std::vector<OrderMsg>& msgs, uint64_t& trades) {
+    double best = 1e30;
+    for (int r{}; r < RUNS; r++) {
+        auto engine = std::make_unique<BasicMatcher<Risk>>();
+        uint64_t t = 0;
+        const uint64_t start = now_ns();
+        for (const OrderMsg& m : msgs) {
+            engine->on_msg(m, [&t](const ExecReport& r) { t += (r.type == ExecType::Trade); });
+        }
+        const double ns = (double)(now_ns() - start) / msgs.size();
+        if (ns < best) { best = ns; }
+        trades = t;
+    }
+    return best;
+}
+
+int main() {
+    const std::vector<OrderMsg> msgs = make_stream(NUM_MSGS);
+    uint64_t trades_plain = 0, trades_risk = 0;
+    const double plain = run<NoRisk>(msgs, trades_plain);
+    const double gated = run<BookRisk>(msgs, trades_risk);
+    std::printf("msgs=%u no_risk=%.2f ns/msg risk=%.2f ns/msg delta=%.2f ns/msg\n",
+                NUM_MSGS, plain, gated, gated - plain);
+    std::printf("trades no_risk=%lu risk=%lu\n", trades_plain, trades_risk);
+    return 0;
+}
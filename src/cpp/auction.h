@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <immintrin.h>
+#include <vector>
+#include "order_book.h"
+
+// Inclusive prefix sum of n level quantities, out[i] = in[0] + ... + in[i]. Each
+// vector is summed in-register (log2(lanes) shift+add steps) and the running
+// total is carried into the next one as a broadcast.
+static inline void prefix_sum_levels(const uint64_t* in, uint64_t* out, uint32_t n) {
+    uint32_t i = 0;
+    uint64_t carry = 0;
+#if defined(__AVX512F__)
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i last = _mm512_set1_epi64(7);
+    __m512i c = zero;
+    for (; i + 8 <= n; i += 8) {
+        __m512i x = _mm512_loadu_si512(in + i);
+        x = _mm512_add_epi64(x, _mm512_maskz_alignr_epi64(0xFF, x, zero, 7)); // lanes shifted up by 1
+        x = _mm512_add_epi64(x, _mm512_maskz_alignr_epi64(0xFF, x, zero, 6)); // by 2
+        x = _mm512_add_epi64(x, _mm512_maskz_alignr_epi64(0xFF, x, zero, 4)); // by 4
+        x = _mm512_add_epi64(x, c);
+        _mm512_storeu_si512(out + i, x);
+        c = _mm512_maskz_permutexvar_epi64(0xFF, last, x);
+    }
+    if (i != 0) { carry = out[i - 1]; }
+#elif defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i c = zero;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), zero, 0x03));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x40), zero, 0x0F));
+        x = _mm256_add_epi64(x, c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+        c = _mm256_permute4x64_epi64(x, 0xFF);
+    }
+    if (i != 0) { carry = out[i - 1]; }
+#endif
+    for (; i < n; ++i) {
+        carry += in[i];
+        out[i] = carry;
+    }
+}
+
+struct AuctionResult {
+    uint32_t price_tick;
+    uint64_t volume;      // executable at price_tick, both sides
+    uint64_t bid_depth;   // bid qty at or above price_tick
+    uint64_t ask_depth;   // ask qty at or below price_tick
+};
+
+// Single-price call auction over a pair of VectorOrderBooks. While the books are
+// accumulating they may cross; uncross() picks the price that executes the most
+// qty, then the least imbalance, then the one nearest ref_px (the last trade, or
+// the middle of the crossed range when there is none), and fills everything
+// executable at that one price. Scratch is sized once for the whole price range.
+class CallAuction {
+    std::vector<uint64_t> cum_bid_;
+    std::vector<uint64_t> cum_ask_;
+    std::vector<Order> ask_fills_;
+
+public:
+    explicit CallAuction(uint32_t levels) : cum_bid_(levels), cum_ask_(levels) {
+        ask_fills_.reserve(1024);
+    }
+
+    // Only reads the aggregates; false when the books don't cross
+    template <typename Bids, typename Asks>
+    inline bool clearing_price(Bids& bids, Asks& asks, uint32_t ref_px, AuctionResult& out) {
+        uint32_t hi, lo;
+        if (!bids.best_price(hi) || !asks.best_price(lo) || hi < lo) { return false; }
+        const uint32_t n = hi - lo + 1;
+        // ascending over [lo, hi]: asks at or below p, and bids below p by subtraction
+        prefix_sum_levels(asks.level_qty_at(lo), cum_ask_.data(), n);
+        prefix_sum_levels(bids.level_qty_at(lo), cum_bid_.data(), n);
+        const uint64_t bid_total = cum_bid_[n - 1];
+        if (ref_px == 0) { ref_px = lo + (hi - lo) / 2; }
+
+        uint64_t best_vol = 0;
+        uint64_t best_imb = 0;
+        uint32_t best_dist = 0;
+        for (uint32_t i{}; i < n; i++) {
+            const uint64_t d = bid_total - (i ? cum_bid_[i - 1] : 0);
+            const uint64_t s = cum_ask_[i];
+            const uint64_t vol = (d < s) ? d : s;
+            const uint64_t imb = (d < s) ? s - d : d - s;
+            const uint32_t px = lo + i;
+            const uint32_t dist = (px > ref_px) ? px - ref_px : ref_px - px;
+            if (vol > best_vol || (vol == best_vol && (imb < best_imb ||
+                    (imb == best_imb && dist < best_dist)))) {
+                best_vol = vol;
+                best_imb = imb;
+                best_dist = dist;
+                out = AuctionResult{px, vol, d, s};
+            }
+        }
+        return best_vol != 0;
+    }
+
+    // Leaves accumulate mode and fills at one price. Each side is swept whole levels
+    // at a time like an aggressive order, asks first into scratch, then bids paired
+    // against them: on_trade(bid_id, ask_id, price_tick, qty). Returns the volume.
+    template <typename Bids, typename Asks, typename OnTrade>
+    inline uint64_t uncross(Bids& bids, Asks& asks, uint32_t ref_px, OnTrade&& on_trade) {
+        bids.set_accumulate(false);
+        asks.set_accumulate(false);
+        AuctionResult r{};
+        if (!clearing_price(bids, asks, ref_px, r)) { return 0; }
+        const uint32_t px = r.price_tick;
+        // per side qty fits the sweep's uint32_t, one auction can need several passes
+        uint64_t left = r.volume;
+        while (left > 0) {
+            const uint32_t chunk = (left > UINT32_MAX) ? UINT32_MAX : (uint32_t)left;
+            ask_fills_.clear();
+            asks.sweep(px, chunk, [&](uint32_t id, uint32_t, uint32_t q) {
+                ask_fills_.push_back(Order{id, q});
+            });
+            size_t k = 0;
+            bids.sweep(px, chunk, [&](uint32_t id, uint32_t, uint32_t q) {
+                while (q > 0) {
+                    Order& a = ask_fills_[k];
+                    const uint32_t f = (a.qty < q) ? a.qty : q;
+                    on_trade(id, a.order_id, px, f);
+                    a.qty -= f;
+                    q -= f;
+                    if (a.qty == 0) { ++k; }
+                }
+            });
+            left -= chunk;
+        }
+        return r.volume;
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include "order_book.h"
+
+static constexpr uint32_t SNAPSHOT_DEPTH = 8;
+
+// What readers get: the top SNAPSHOT_DEPTH levels per side and how far into the
+// report stream the book was when it was taken
+struct BookView {
+    uint32_t exec_seq;        // last ExecReport folded in
+    uint32_t last_trade_px;
+    uint32_t bid_levels;
+    uint32_t ask_levels;
+    LevelView bids[SNAPSHOT_DEPTH];
+    LevelView asks[SNAPSHOT_DEPTH];
+};
+
+// Single-writer seqlock. The matcher bumps seq to odd, writes, bumps it back to
+// even; readers copy and retry until the same even seq brackets the copy. Readers
+// only load, so they never pull the matcher's lines into exclusive state.
+class BookSnapshot {
+    static constexpr size_t kWords = (sizeof(BookView) + 7) / 8;
+
+    alignas(64) std::atomic<uint32_t> seq_{0};
+    alignas(64) std::atomic<uint64_t> words_[kWords]{};
+
+public:
+    inline void publish(const BookView& v) {
+        uint64_t buf[kWords]{};
+        std::memcpy(buf, &v, sizeof(v));
+        const uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i{}; i < kWords; i++) {
+            words_[i].store(buf[i], std::memory_order_relaxed);
+        }
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    // false only if nothing has been published yet
+    inline bool read(BookView& out) const {
+        uint64_t buf[kWords];
+        for (;;) {
+            const uint32_t s1 = seq_.load(std::memory_order_acquire);
+            if (s1 == 0) { return false; }
+            if (s1 & 1) {
+                _mm_pause();
+                continue;
+            }
+            for (size_t i{}; i < kWords; i++) {
+                buf[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == s1) { break; }
+        }
+        std::memcpy(&out, buf, sizeof(out));
+        return true;
+    }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <arpa/inet.h>
+#include "metrics.h"
+
+// A/B arbitration for order flow that is sent twice, on two UDP ports (lines A and
+// B) that xdp_kernal.c both redirects to our queue. Arbitration itself is the session
+// dedupe window: whichever copy of a seq arrives first goes to the matcher and the
+// other is dropped, so a late or lost packet on one line never holds matching back.
+// FeedArb adds what the window can't tell: per line, how many copies came in and
+// how many of them won, the seqs the line skipped even when the other line covered
+// them, and for sampled seqs how far behind the winner the losing copy was.
+//
+// Both copies have to map to the same session, so A/B needs wire v2 with the same
+// header session from the same source ip on both lines. Lines are assumed to deliver
+// in order: a copy of a seq below what its own line already delivered is a real
+// duplicate, anything else the window has seen is just the other line's copy.
+static constexpr uint32_t FEED_LINES = 2;
+static constexpr uint32_t ARB_SAMPLE_MASK = 7; // one seq in 8 timed for line lag
+static constexpr uint32_t ARB_SLOTS = 32;      // sampled seqs remembered, spans the 256-seq window
+static_assert(sizeof(RecvMetrics::line_copies) / sizeof(Counter) == FEED_LINES);
+
+class FeedArb {
+    struct Sample {
+        uint32_t seq;
+        uint32_t line;
+        uint64_t rx_ns;  // winning copy's XDP timestamp, 0 once the other copy was timed
+    };
+    struct SessionLines {
+        uint32_t next[FEED_LINES]; // one past the highest seq each line delivered, 0 before any
+        Sample first[ARB_SLOTS];
+    };
+
+    std::vector<SessionLines> sessions_;
+    uint16_t port_a_; // network order, as in the UDP header
+    uint16_t port_b_;
+    uint64_t copies_[FEED_LINES]{}; // since the last publish
+    uint64_t wins_[FEED_LINES]{};
+    uint64_t gaps_[FEED_LINES]{};
+
+public:
+    FeedArb(uint32_t max_sessions, uint16_t port_a, uint16_t port_b)
+        : sessions_(max_sessions), port_a_(htons(port_a)), port_b_(htons(port_b)) {}
+
+    inline uint16_t port_b() const { return ntohs(port_b_); }
+
+    // a session id that now belongs to a new source starts with no line history
+    inline void reset(uint16_t session) { sessions_[session] = SessionLines{}; }
+
+    // line a frame came in on, from its UDP dest port (network order)
+    inline uint32_t line(uint16_t dest) const { return (dest == port_a_) ? 0 : 1; }
+
+    // Every copy the session window looked at; seen is what the window said. Returns
+    // true when this line had already delivered seq, a duplicate rather than a copy.
+    inline bool on_copy(uint16_t session, uint32_t line, uint32_t seq, bool seen, uint64_t rx_ns,
+                        RecvMetrics& m) {
+        SessionLines& s = sessions_[session];
+        uint32_t& next = s.next[line];
+        const bool repeat = seen && next != 0 && seq < next;
+        ++copies_[line];
+        if (!seen) { ++wins_[line]; }
+        if (next != 0 && seq > next) { gaps_[line] += seq - next; }
+        if (seq >= next) { next = seq + 1; }
+        if ((seq & ARB_SAMPLE_MASK) != 0 || rx_ns == 0 || repeat) { return repeat; }
+        Sample& x = s.first[(seq / (ARB_SAMPLE_MASK + 1)) % ARB_SLOTS];
+        if (!seen) {
+            x = Sample{seq, line, rx_ns};
+        }
+        else if (x.seq == seq && x.line != line && x.rx_ns != 0 && rx_ns >= x.rx_ns) {
+            m.line_lag[line].record(rx_ns - x.rx_ns);
+            x.rx_ns = 0;
+        }
+        return false;
+    }
+
+    // once per RX batch, so the counters are one store each
+    inline void publish(RecvMetrics& m) {
+        for (uint32_t l{}; l < FEED_LINES; l++) {
+            if (copies_[l]) { m.line_copies[l].add(copies_[l]); }
+            if (wins_[l]) { m.line_wins[l].add(wins_[l]); }
+            if (gaps_[l]) { m.line_gaps[l].add(gaps_[l]); }
+            copies_[l] = wins_[l] = gaps_[l] = 0;
+        }
+    }
+};
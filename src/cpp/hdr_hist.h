@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// HDR-style latency histogram for the load generator. Values fall into power-of-two
+// ranges, each split into 2^SubBits linear sub-buckets, so every value keeps SubBits
+// bits of precision (7: under 1% error) from 1ns up to 2^MaxBits ns (~18 minutes).
+// Same layout as metrics.h's LatencyHist, which only keeps 2 bits to stay small.
+template <uint32_t SubBits = 7, uint32_t MaxBits = 40>
+class HdrHist {
+    static_assert(SubBits < MaxBits && MaxBits < 64, "invalid histogram range");
+    static constexpr uint64_t kSub = 1ULL << SubBits;
+    static constexpr uint32_t kBuckets = (MaxBits - SubBits + 1) * (uint32_t)kSub;
+
+    std::vector<uint64_t> counts_ = std::vector<uint64_t>(kBuckets);
+    uint64_t total_{0};
+    uint64_t max_{0};
+    long double sum_{0};
+
+    static inline uint32_t index(uint64_t v) {
+        if (v < kSub) { return (uint32_t)v; }
+        const uint32_t msb = 63 - (uint32_t)__builtin_clzll(v);
+        const uint32_t shift = msb - SubBits;
+        const uint64_t i = ((uint64_t)(shift + 1) << SubBits) + ((v >> shift) & (kSub - 1));
+        return (i < kBuckets) ? (uint32_t)i : kBuckets - 1;
+    }
+
+    // largest value that lands in bucket i
+    static inline uint64_t highest(uint32_t i) {
+        if (i < kSub) { return i; }
+        const uint32_t shift = (i >> SubBits) - 1;
+        const uint64_t sub = i & (kSub - 1);
+        return ((kSub + sub + 1) << shift) - 1;
+    }
+
+public:
+    inline void record(uint64_t v, uint64_t n = 1) {
+        counts_[index(v)] += n;
+        total_ += n;
+        sum_ += (long double)v * n;
+        if (v > max_) { max_ = v; }
+    }
+
+    // Coordinated-omission correction for samples taken by a sender that waits for
+    // each reply: a stall of v also delayed the sends that should have gone out every
+    // expected_interval during it, so those get the latencies they would have seen.
+    // Not needed when latency is measured from the intended send time.
+    inline void record_corrected(uint64_t v, uint64_t expected_interval) {
+        record(v);
+        if (expected_interval == 0) { return; }
+        for (uint64_t m = (v > expected_interval) ? v - expected_interval : 0; m >= expected_interval;
+             m -= expected_interval) {
+            record(m);
+        }
+    }
+
+    inline uint64_t count() const { return total_; }
+    inline uint64_t max() const { return max_; }
+    inline double mean() const { return total_ ? (double)(sum_ / total_) : 0.0; }
+
+    // p in [0, 100], reported as the top of the bucket it falls in
+    inline uint64_t value_at(double p) const {
+        if (total_ == 0) { return 0; }
+        uint64_t rank = (uint64_t)std::ceil(p / 100.0 * (double)total_);
+        if (rank == 0) { rank = 1; }
+        if (rank > total_) { rank = total_; }
+        uint64_t seen = 0;
+        for (uint32_t i{}; i < kBuckets; i++) {
+            seen += counts_[i];
+            if (seen >= rank) { return (highest(i) < max_) ? highest(i) : max_; }
+        }
+        return max_;
+    }
+
+    // HdrHistogram's percentile distribution text, which its plotters read:
+    // value, percentile, total count, 1/(1-percentile), in ticks of halving tails
+    inline void print_distribution(FILE* out, double unit = 1.0, uint32_t ticks_per_half = 5) const {
+        std::fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+        if (total_ == 0) { return; }
+        double pct = 0.0;
+        double step = 50.0 / ticks_per_half;
+        for (uint32_t t = 0;; t++) {
+            const uint64_t v = value_at(pct);
+            uint64_t below = 0;
+            for (uint32_t i{}; i <= index(v); i++) { below += counts_[i]; }
+            if (pct >= 100.0 || below == total_) {
+                std::fprintf(out, "%12.3f %14.12f %10lu\n", v / unit, 1.0, (unsigned long)total_);
+                break;
+            }
+            std::fprintf(out, "%12.3f %14.12f %10lu %14.2f\n", v / unit, pct / 100.0, (unsigned long)below,
+                         1.0 / (1.0 - pct / 100.0));
+            pct += step;
+            if (t + 1 == ticks_per_half) { // next half of what's left, in finer steps
+                t = (uint32_t)-1;
+                step /= 2;
+            }
+        }
+        std::fprintf(out, "#[Mean = %.3f, Max = %.3f, Total count = %lu]\n", mean() / unit, max_ / unit,
+                     (unsigned long)total_);
+    }
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "match.h"
+#include "recv_helper.h"
+
+// Which thread layout xdp_recv runs. ThreeThread hands every message across two
+// SPSC rings (recv -> matcher -> report sender) on three pinned cores, so each
+// one pays two cross-core line transfers but the stages overlap. RunToCompletion
+// peeks, parses, matches and sends reports on the receive thread alone: nothing
+// crosses a core, but the next RX batch waits for this one's matching and sends.
+// src/bench/pipeline_bench compares the two at several input rates.
+enum class Pipeline : uint8_t { ThreeThread, RunToCompletion };
+
+// decode_payloads target when there is no ring in between
+struct LocalSlots {
+    OrderMsg* base;
+    inline OrderMsg* producer_slot(uint32_t i) { return base + i; }
+};
+
+// The match loop's work for one RX batch, on the calling thread: decode straight
+// into a local array, run every message through the Matcher, hand reports to emit.
+// replica and warm work as in match_loop.
+class InlineMatcher {
+    std::unique_ptr<Matcher> engine_;
+    std::vector<OrderMsg> decoded_;
+    MatchMetrics& metrics_;
+    BookSnapshot* snapshot_;
+    ReplicaFeed* replica_;
+    BookView view_{};
+    uint64_t auction_end_ns_ = 0;
+
+public:
+    InlineMatcher(uint32_t max_batch, MatchMetrics& metrics, BookSnapshot* snapshot = nullptr,
+                  ReplicaFeed* replica = nullptr, std::unique_ptr<Matcher> warm = nullptr)
+        : engine_(std::move(warm)), decoded_(max_batch), metrics_(metrics), snapshot_(snapshot),
+          replica_(replica) {
+        if (!engine_) {
+            engine_ = std::make_unique<Matcher>();
+            if (OPENING_AUCTION_NS != 0) { engine_->begin_auction(); }
+        }
+    }
+
+    template <typename Emit>
+    inline void run(const RxMsg* msgs, uint32_t n, Emit&& emit) {
+        if (n == 0) { return; }
+        auto counted = [&](const ExecReport& r) {
+            count_report(metrics_, r);
+            if (replica_) { replica_->on_report(r); }
+            emit(r);
+        };
+        if (engine_->in_auction()) { check_auction(counted); }
+        LocalSlots slots{decoded_.data()};
+        decode_payloads(msgs, n, slots);
+        for (uint32_t i{}; i < n; i++) {
+            const uint64_t trades_before = metrics_.trades.get();
+            engine_->on_msg(decoded_[i], counted);
+            sample_wire(metrics_, decoded_[i], trades_before);
+            if (replica_) { replica_->append(decoded_[i], engine_->exec_seq()); }
+        }
+        metrics_.msgs.add(n);
+        if (snapshot_) { publish(); } // once per batch, readers see it between batches
+        if (replica_) { replica_->publish(); }
+    }
+
+    // no RX this time round: idle compaction, and an auction may be due
+    template <typename Emit>
+    inline void on_idle(Emit&& emit) {
+        if (engine_->in_auction() && auction_end_ns_ != 0) {
+            check_auction([&](const ExecReport& r) {
+                count_report(metrics_, r);
+                if (replica_) { replica_->on_report(r); }
+                emit(r);
+            });
+            if (replica_) { replica_->publish(); }
+        }
+        engine_->on_idle();
+    }
+
+private:
+    template <typename Emit>
+    inline void check_auction(Emit&& emit) {
+        const uint64_t now = metrics_now_ns();
+        if (auction_end_ns_ == 0) { auction_end_ns_ = now + OPENING_AUCTION_NS; }
+        if (now < auction_end_ns_) { return; }
+        engine_->uncross(emit);
+        if (replica_) { replica_->append_uncross(engine_->exec_seq()); }
+        auction_end_ns_ = 0;
+        if (snapshot_) { publish(); }
+    }
+
+    inline void publish() {
+        engine_->snapshot(view_);
+        snapshot_->publish(view_);
+    }
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "spsc_ring.h"
+#include "book_types.h"
+#include "metrics.h"
+#include "../cpp_helpers/protocols.hpp"
+
+// Order entry for strategies on the engine's own host, skipping UDP, the NIC and
+// XDP. The engine creates one shared-memory segment (/dev/shm/order_matcher_local)
+// with LOCAL_SESSIONS slots. A client (LocalClient below) claims a free slot and
+// writes host-order OrderMsgs straight into the slot's order ring. The matcher
+// polls the claimed slots in turn with its other rings and answers on the slot's
+// report ring: acks and rejects for the slot's own messages, and every trade
+// where one side is the slot's order. Everything still goes out on the UDP report
+// stream as well, so exec_seq there stays gapless.
+//
+// Each slot is a fixed session id (LOCAL_SESSION_BASE + slot). The matcher stamps
+// it on every message, so a client can't trade as another session. A client that
+// claims a slot records its pid and where its messages start in the order ring
+// (claim). Messages queued ahead of that were left by the previous owner and are
+// dropped unmatched. Ahead of the new owner's first message the matcher gets a
+// Control::Bind for the slot's id, which cancels whatever the previous owner left
+// resting and resets the id's risk state. The segment is 0660, so clients have to
+// run as the engine's user or group. The matcher
+// never waits on a client: a report that doesn't fit the client's ring is dropped
+// and counted in the slot. Both ends poll, and the rings' futex wakes don't cross
+// processes, so clients should use SpinWait, BusySpinWait or UmwaitWait.
+
+static constexpr const char* LOCAL_SHM_NAME = "/order_matcher_local";
+static constexpr uint32_t LOCAL_MAGIC = 0x4f4d4c49; // "OMLI"
+static constexpr uint32_t LOCAL_VERSION = 2;
+static constexpr uint32_t LOCAL_RING_SIZE = 4096;
+static constexpr uint32_t LOCAL_RESCAN_EVERY = 4096; // messages between claim rescans under load
+
+using LocalOrderRing = SpscRing<OrderMsg, LOCAL_RING_SIZE>;    // client -> matcher
+using LocalReportRing = SpscRing<ExecReport, LOCAL_RING_SIZE>; // matcher -> client
+
+struct LocalSlot {
+    std::atomic<uint32_t> owner;   // client pid, 0 when free
+    std::atomic<uint32_t> dropped; // reports lost to a full report ring, matcher writes
+    std::atomic<uint32_t> stale;   // previous owner's orders dropped on a reclaim, matcher writes
+    std::atomic<uint64_t> claim;   // owner pid << 32 | order ring position of its first message
+    alignas(64) LocalOrderRing orders;
+    alignas(64) LocalReportRing reports;
+};
+
+struct LocalSegment {
+    std::atomic<uint32_t> magic; // written last, clients check it
+    uint32_t version;
+    uint64_t pid;                // engine
+    alignas(64) LocalSlot slots[LOCAL_SESSIONS];
+};
+
+static inline bool local_session(uint16_t session) { return session >= LOCAL_SESSION_BASE; }
+
+// Matcher side, owned by the match loop. on() is false when the segment could not
+// be created; the engine then runs without local order entry.
+class LocalIngress {
+    LocalSegment* seg_ = nullptr;
+    uint32_t active_[LOCAL_SESSIONS];
+    uint32_t n_active_ = 0;
+    uint32_t turn_ = 0;          // next active_ entry to try
+    uint32_t cur_ = 0;           // slot of the message being matched
+    uint32_t since_scan_ = 0;
+    uint32_t bound_[LOCAL_SESSIONS]{}; // claim pid each slot was last bound to
+    bool binding_ = false;             // msg_ is a Bind, the ring slot stays put
+    OrderMsg msg_{};
+
+public:
+    explicit LocalIngress(const char* name = LOCAL_SHM_NAME) {
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0660);
+        if (fd < 0) {
+            std::perror("shm_open local");
+            return;
+        }
+        fchmod(fd, 0660); // past the umask, so the clients' group can write too
+        if (ftruncate(fd, sizeof(LocalSegment)) != 0) {
+            std::perror("ftruncate local");
+            close(fd);
+            return;
+        }
+        void* p = mmap(nullptr, sizeof(LocalSegment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            std::perror("mmap local");
+            return;
+        }
+        seg_ = new (p) LocalSegment{}; // empty rings, every slot free
+        seg_->version = LOCAL_VERSION;
+        seg_->pid = (uint64_t)getpid();
+        seg_->magic.store(LOCAL_MAGIC, std::memory_order_release);
+    }
+    ~LocalIngress() {
+        if (!seg_) { return; }
+        seg_->magic.store(0, std::memory_order_release); // clients see the engine went away
+        munmap(seg_, sizeof(LocalSegment));
+    }
+    LocalIngress(const LocalIngress&) = delete;
+    LocalIngress& operator=(const LocalIngress&) = delete;
+
+    inline bool on() const { return seg_ != nullptr; }
+
+    // Claimed slots, plus any a client left with orders still queued. Reads one
+    // line per slot, so it runs when the match loop idles and every LOCAL_RESCAN_EVERY.
+    // Returns how many there are.
+    inline uint32_t rescan() {
+        n_active_ = 0;
+        since_scan_ = 0;
+        for (uint32_t i{}; i < LOCAL_SESSIONS; i++) {
+            LocalSlot& s = seg_->slots[i];
+            OrderMsg* m;
+            if (s.owner.load(std::memory_order_acquire) != 0 || s.orders.try_acquire_consumer_slot(m)) {
+                active_[n_active_++] = i;
+            }
+        }
+        return n_active_;
+    }
+
+    // next message from the active slots in turn, copied out with the slot's session,
+    // or a Bind when the slot has changed hands since its last message
+    inline bool try_acquire(OrderMsg*& out) {
+        if (++since_scan_ >= LOCAL_RESCAN_EVERY) { rescan(); }
+        for (uint32_t k{}; k < n_active_; k++) {
+            const uint32_t i = active_[turn_ < n_active_ ? turn_ : 0];
+            turn_ = (turn_ + 1 < n_active_) ? turn_ + 1 : 0;
+            LocalSlot& s = seg_->slots[i];
+            OrderMsg* m;
+            while (s.orders.try_acquire_consumer_slot(m)) {
+                // the claim was stored before the owner's first message was committed
+                const uint64_t claim = s.claim.load(std::memory_order_acquire);
+                const uint32_t owner = (uint32_t)(claim >> 32);
+                if ((int32_t)(s.orders.consumer_pos() - (uint32_t)claim) < 0) { // queued before the claim
+                    s.orders.release_consumer_slot();
+                    s.stale.store(s.stale.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    continue;
+                }
+                binding_ = owner != 0 && owner != bound_[i];
+                if (binding_) {
+                    bound_[i] = owner;
+                    msg_ = OrderMsg{};
+                    msg_.session = CONTROL_SESSION;
+                    msg_.msg_type = static_cast<MsgType>(Control::Bind);
+                    msg_.qty = LOCAL_SESSION_BASE + i;
+                    msg_.order_id = owner;
+                }
+                else {
+                    msg_ = *m;
+                    msg_.session = (uint16_t)(LOCAL_SESSION_BASE + i);
+                }
+                cur_ = i;
+                out = &msg_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline void release() {
+        if (!binding_) { seg_->slots[cur_].orders.release_consumer_slot(); }
+    }
+
+    // every report the matcher emits; from_local when it answers the current local message
+    template <typename Engine>
+    inline void on_report(const ExecReport& r, const Engine& engine, bool from_local) {
+        if (r.type == ExecType::Trade) {
+            const uint16_t bid = engine.risk.owner(r.order_id);
+            const uint16_t ask = engine.risk.owner(r.other_id);
+            if (local_session(bid)) { push(bid - LOCAL_SESSION_BASE, r); }
+            if (local_session(ask) && ask != bid) { push(ask - LOCAL_SESSION_BASE, r); }
+        }
+        else if (from_local && !binding_) { // a Bind's cancels were the previous owner's
+            push(cur_, r);
+        }
+    }
+
+private:
+    inline void push(uint32_t i, const ExecReport& r) {
+        LocalSlot& s = seg_->slots[i];
+        ExecReport* slot;
+        if (!s.reports.try_acquire_producer_slot(slot)) {
+            s.dropped.store(s.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        *slot = r;
+        s.reports.commit_producer_slot();
+    }
+};
+
+// Client side, for a strategy process. on() is false when there is no engine or
+// every slot is taken. A slot whose owner has exited is free to claim again.
+class LocalClient {
+    LocalSegment* seg_ = nullptr;
+    LocalSlot* slot_ = nullptr;
+    uint16_t session_ = 0;
+    uint32_t next_seq_ = 1;
+
+public:
+    explicit LocalClient(const char* name = LOCAL_SHM_NAME) {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) { return; }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LocalSegment)) {
+            close(fd);
+            return;
+        }
+        void* p = mmap(nullptr, sizeof(LocalSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            std::perror("mmap local");
+            return;
+        }
+        seg_ = static_cast<LocalSegment*>(p);
+        if (seg_->magic.load(std::memory_order_acquire) != LOCAL_MAGIC || seg_->version != LOCAL_VERSION) {
+            munmap(p, sizeof(LocalSegment));
+            seg_ = nullptr;
+            return;
+        }
+        const uint32_t me = (uint32_t)getpid();
+        for (uint32_t i{}; i < LOCAL_SESSIONS && !slot_; i++) {
+            LocalSlot& s = seg_->slots[i];
+            uint32_t owner = s.owner.load(std::memory_order_acquire);
+            const bool dead = owner != 0 && kill((pid_t)owner, 0) != 0 && errno == ESRCH;
+            if ((owner == 0 || dead) &&
+                    s.owner.compare_exchange_strong(owner, me, std::memory_order_acq_rel)) {
+                slot_ = &s;
+                session_ = (uint16_t)(LOCAL_SESSION_BASE + i);
+            }
+        }
+        if (!slot_) { return; }
+        ExecReport* stale; // left over from a previous owner
+        while (slot_->reports.try_acquire_consumer_slot(stale)) { slot_->reports.release_consumer_slot(); }
+        // a previous owner's queued orders sit below here and the matcher drops them
+        slot_->claim.store(((uint64_t)me << 32) | slot_->orders.producer_pos(), std::memory_order_release);
+    }
+    ~LocalClient() {
+        if (slot_) { slot_->owner.store(0, std::memory_order_release); }
+        if (seg_) { munmap(seg_, sizeof(LocalSegment)); }
+    }
+    LocalClient(const LocalClient&) = delete;
+    LocalClient& operator=(const LocalClient&) = delete;
+
+    inline bool on() const { return slot_ != nullptr; }
+    inline uint16_t session() const { return session_; }
+    inline bool engine_up() const { return seg_->magic.load(std::memory_order_acquire) == LOCAL_MAGIC; }
+    inline uint32_t dropped() const { return slot_->dropped.load(std::memory_order_relaxed); }
+
+    // seq_num, session and rx_ns are filled in; false when the order ring is full
+    inline bool send(const OrderMsg& m) {
+        OrderMsg* slot;
+        if (!slot_->orders.try_acquire_producer_slot(slot)) { return false; }
+        *slot = m;
+        slot->seq_num = next_seq_++;
+        slot->session = session_;
+        slot->rx_ns = metrics_now_ns(); // same clock as XDP's, so wire_to_match covers it
+        slot_->orders.commit_producer_slot();
+        return true;
+    }
+
+    inline bool poll(ExecReport& out) {
+        ExecReport* slot;
+        if (!slot_->reports.try_acquire_consumer_slot(slot)) { return false; }
+        out = *slot;
+        slot_->reports.release_consumer_slot();
+        return true;
+    }
+};
@@ -1,89 +1,166 @@
+#include <memory>
 #include "match.h"
-#include "book_types.h"
+#include "local_ingress.h"
+#include "perf_counters.h"
 
-void match_loop(OrderMsgRing& ring, TradeMsgRing& trades, std::atomic<bool>& running,
-        std::atomic<uint64_t>& trades_total) {
+template <typename Wait>
+void match_loop(OrderMsgRing& ring, ReportRing& reports, std::atomic<bool>& running,
+        MatchMetrics& metrics, BookSnapshot* snapshot, ReplicaFeed* replica, Matcher* warm,
+        OrderMsgRing* gateway, LocalIngress* local, GwReportRing* gateway_reports) {
 
-    Books book;
-    SpinWait ring_wait;
-    SpinWait trade_wait;
+    std::unique_ptr<Matcher> fresh;
+    if (!warm) {
+        fresh = std::make_unique<Matcher>();
+        if (OPENING_AUCTION_NS != 0) { fresh->begin_auction(); }
+    }
+    Matcher& engine = warm ? *warm : *fresh;
+    Wait ring_wait;
+    Wait report_wait;
+    ring_wait.stats = &metrics.wait;
+    report_wait.stats = &metrics.wait;
+    StagePerf perf(metrics.perf);
+    uint32_t run = 0; // messages since perf.begin()
+    BookView view{};
+    uint32_t unpublished = 0;
+    auto publish = [&]() {
+        engine.snapshot(view);
+        snapshot->publish(view);
+        unpublished = 0;
+    };
 
-    while (running.load(std::memory_order_acquire)) {
-        OrderMsg* slot = nullptr;
-        while (!ring.try_acquire_consumer_slot(slot)) {
-            if (!running.load(std::memory_order_acquire)) { return; }
-            ring_wait.pause();
+    // ingress sources take turns, one message each, so none starves
+    enum class Source : uint8_t { Xdp, Gateway, Local };
+    Source from = Source::Xdp;
+    auto try_source = [&](Source s, OrderMsg*& slot) {
+        switch (s) {
+            case Source::Xdp: return ring.try_acquire_consumer_slot(slot);
+            case Source::Gateway: return gateway && gateway->try_acquire_consumer_slot(slot);
+            case Source::Local: return local && local->try_acquire(slot);
         }
-        ring_wait.reset();
-        OrderMsg& msg = *slot;
-        const bool taker_is_buy = (msg.side == Order_Type::Buy);
-
-        switch (msg.msg_type) {
-            case MsgType::NewLimit:
-                if (msg.side == Order_Type::Buy) {
-                    book.bids.on_new_limit(msg.order_id, msg.price_tick, msg.qty);
-                } 
-                else {
-                    book.asks.on_new_limit(msg.order_id, msg.price_tick, msg.qty);
-                }
-                break;
-
-            case MsgType::Cancel:
-                if (msg.side == Order_Type::Buy) {
-                    book.bids.on_cancel(msg.order_id);
-                } 
-                else {
-                    book.asks.on_cancel(msg.order_id);
-                }
-                break;
-
-            case MsgType::Modify:
-                if (msg.side == Order_Type::Buy) {
-                    book.bids.on_modify(msg.order_id, msg.price_tick, msg.qty);
-                } 
-                else {
-                    book.asks.on_modify(msg.order_id, msg.price_tick, msg.qty);
-                }
-                break;
-
-            default:
-                break;
+        return false;
+    };
+    auto next_slot = [&](OrderMsg*& slot) {
+        if (!gateway && !local) { return ring.try_acquire_consumer_slot(slot); }
+        for (uint8_t k = 1; k <= 3; k++) {
+            const Source s = static_cast<Source>(((uint8_t)from + k) % 3);
+            if (try_source(s, slot)) {
+                from = s;
+                return true;
+            }
+        }
+        return false;
+    };
+    auto release_slot = [&]() {
+        switch (from) {
+            case Source::Xdp: ring.release_consumer_slot(); break;
+            case Source::Gateway: gateway->release_consumer_slot(); break;
+            case Source::Local: local->release(); break;
         }
+    };
 
-        // match crossing book
-        uint32_t best_bid_price, best_ask_price;
-        while (book.bids.best_price(best_bid_price) && book.asks.best_price(best_ask_price)
-               && best_bid_price >= best_ask_price) {
+    // a gateway session's copy; answering is the gateway session whose message is in
+    // on_msg, 0 otherwise (a Bind's cancels were the previous owner's)
+    uint16_t answering = 0;
+    auto gw_session = [](uint16_t id) { return id >= UDP_SESSIONS && id < LOCAL_SESSION_BASE; };
+    auto to_gateway = [&](uint16_t id, const ExecReport& r) {
+        GwReport* g;
+        if (!gateway_reports->try_acquire_producer_slot(g)) {
+            metrics.gw_report_drops.add();
+            return;
+        }
+        g->report = r;
+        g->session = id;
+        gateway_reports->commit_producer_slot();
+    };
 
-            uint32_t bid_px, ask_px;
-            Order* bid_o = book.bids.best_order(bid_px);
-            Order* ask_o = book.asks.best_order(ask_px);
+    // acks, rejects and trades go straight onto the outbound ring
+    auto emit = [&](const ExecReport& r) {
+        ExecReport* rslot = nullptr;
+        while (!reports.try_acquire_producer_slot(rslot)) {
+            if (!running.load(std::memory_order_acquire)) { return; }
+            report_wait.pause(reports.producer_wait_point());
+        }
+        report_wait.reset();
+        *rslot = r;
+        reports.commit_producer_slot();
+        const uint32_t depth = reports.producer_depth();
+        metrics.report_depth.set(depth);
+        metrics.report_hwm.max(depth);
+        count_report(metrics, r);
+        if (replica) { replica->on_report(r); }
+        if (local) { local->on_report(r, engine, from == Source::Local); }
+        if (!gateway_reports) { return; }
+        if (r.type == ExecType::Trade) {
+            const uint16_t bid = engine.risk.owner(r.order_id);
+            const uint16_t ask = engine.risk.owner(r.other_id);
+            if (gw_session(bid)) { to_gateway(bid, r); }
+            if (gw_session(ask) && ask != bid) { to_gateway(ask, r); }
+        }
+        else if (answering != 0) {
+            to_gateway(answering, r);
+        }
+    };
 
-            const uint32_t trade_qty = (bid_o->qty < ask_o->qty) ? bid_o->qty : ask_o->qty;
-            const uint32_t trade_px = taker_is_buy ? ask_px : bid_px;
+    // opening auction: the clock starts at the first message, checked only while it runs
+    uint64_t auction_end_ns = 0;
+    auto maybe_uncross = [&]() {
+        if (auction_end_ns == 0 || metrics_now_ns() < auction_end_ns) { return; }
+        engine.uncross(emit);
+        if (replica) { replica->append_uncross(engine.exec_seq()); }
+        auction_end_ns = 0;
+        if (snapshot) { publish(); }
+    };
 
-            // emit trade
-            TradeMsg* tslot = nullptr;
-            while (!trades.try_acquire_producer_slot(tslot)) {
-                if (!running.load(std::memory_order_acquire)) { return; }
-                trade_wait.pause();
+    while (running.load(std::memory_order_acquire)) {
+        OrderMsg* slot = nullptr;
+        while (!next_slot(slot)) {
+            if (run != 0) {
+                perf.end(run);
+                run = 0;
             }
-            trade_wait.reset();
-            tslot->bid_order_id = bid_o->order_id;
-            tslot->ask_order_id = ask_o->order_id;
-            tslot->price_tick = trade_px;
-            tslot->qty = trade_qty;
-            trades.commit_producer_slot();
-            trades_total.fetch_add(1, std::memory_order_relaxed);
+            if (unpublished != 0 && snapshot) { publish(); } // batch done, book is quiet
+            if (engine.in_auction()) { maybe_uncross(); }
+            if (replica) { replica->publish(); } // standby catches up while we idle
+            if (local) { metrics.local_clients.set(local->rescan()); }
+            engine.on_idle();
+            if (!running.load(std::memory_order_acquire)) { return; }
+            ring_wait.pause(ring.consumer_wait_point());
+        }
+        ring_wait.reset();
+        if (run == 0) { perf.begin(); }
+        OrderMsg& msg = *slot;
+        if (engine.in_auction()) {
+            if (auction_end_ns == 0) { auction_end_ns = metrics_now_ns() + OPENING_AUCTION_NS; }
+            maybe_uncross();
+        }
 
-            // apply fills
-            bid_o->qty -= trade_qty;
-            ask_o->qty -= trade_qty;
+        const uint64_t trades_before = metrics.trades.get();
+        answering = (from == Source::Gateway && gw_session(msg.session)) ? msg.session : 0;
+        engine.on_msg(msg, emit);
+        answering = 0;
+        sample_wire(metrics, msg, trades_before);
+        if (replica) { replica->append(msg, engine.exec_seq()); } // after its reports are out
 
-            if (bid_o->qty == 0) { book.bids.remove_best(bid_px); }
-            if (ask_o->qty == 0) { book.asks.remove_best(ask_px); }
+        if (from == Source::Local) { metrics.local_msgs.add(); }
+        release_slot();
+        metrics.msgs.add();
+        if (++run == PERF_MAX_RUN) {
+            perf.end(run);
+            run = 0;
         }
-
-        ring.release_consumer_slot();
+        if (++unpublished >= SNAPSHOT_EVERY && snapshot) { publish(); }
     }
 }
+
+template void match_loop<SpinWait>(OrderMsgRing&, ReportRing&, std::atomic<bool>&,
+        MatchMetrics&, BookSnapshot*, ReplicaFeed*, Matcher*, OrderMsgRing*, LocalIngress*,
+        GwReportRing*);
+template void match_loop<BusySpinWait>(OrderMsgRing&, ReportRing&, std::atomic<bool>&,
+        MatchMetrics&, BookSnapshot*, ReplicaFeed*, Matcher*, OrderMsgRing*, LocalIngress*,
+        GwReportRing*);
+template void match_loop<UmwaitWait>(OrderMsgRing&, ReportRing&, std::atomic<bool>&,
+        MatchMetrics&, BookSnapshot*, ReplicaFeed*, Matcher*, OrderMsgRing*, LocalIngress*,
+        GwReportRing*);
+template void match_loop<FutexWait>(OrderMsgRing&, ReportRing&, std::atomic<bool>&,
+        MatchMetrics&, BookSnapshot*, ReplicaFeed*, Matcher*, OrderMsgRing*, LocalIngress*,
+        GwReportRing*);
@@ -1,13 +1,64 @@
 #pragma once
 
 #include "spsc_ring.h"
+#include "book_snapshot.h"
+#include "metrics.h"
+#include "matcher.h"
+#include "replica.h"
 #include "../cpp_helpers/protocols.hpp"
 #include <atomic>
 
 static constexpr uint32_t ORDER_RING_SIZE = 16384;
-static constexpr uint32_t TRADE_RING_SIZE = 16384;
+static constexpr uint32_t REPORT_RING_SIZE = 16384;
+static constexpr uint32_t GW_REPORT_RING_SIZE = 65536; // fills for gateway sessions come in bursts
+static constexpr uint32_t SNAPSHOT_EVERY = 64; // max messages between snapshots under load
+static constexpr uint64_t OPENING_AUCTION_NS = 0; // call auction from the first message, 0 = off
+static constexpr uint32_t WIRE_SAMPLE_MASK = 7;    // wire latency for 1 seq in 8, each costs a clock read
 using OrderMsgRing = SpscRing<OrderMsg, ORDER_RING_SIZE>;
-using TradeMsgRing = SpscRing<TradeMsg, TRADE_RING_SIZE>;
+using ReportRing = SpscRing<ExecReport, REPORT_RING_SIZE>; // acks, rejects and trades
 
-void match_loop(OrderMsgRing& ring, TradeMsgRing& trades, std::atomic<bool>& running,
-                std::atomic<uint64_t>& trades_total);
+// a copy of a report for a TCP gateway session, back to its connection (tcp_gateway.h)
+struct GwReport {
+    ExecReport report;
+    uint16_t session;
+    uint16_t pad;
+};
+using GwReportRing = SpscRing<GwReport, GW_REPORT_RING_SIZE>;
+
+class LocalIngress;
+
+static inline void count_report(MatchMetrics& m, const ExecReport& r) {
+    switch (r.type) {
+        case ExecType::Trade: m.trades.add(); break;
+        case ExecType::Ack: m.acks.add(); break;
+        case ExecType::Reject: m.rejects.add(); break;
+    }
+}
+
+// after on_msg: NIC-to-matcher latency for a sampled message that has an XDP timestamp
+static inline void sample_wire(MatchMetrics& m, const OrderMsg& msg, uint64_t trades_before) {
+    if (msg.rx_ns == 0 || (msg.seq_num & WIRE_SAMPLE_MASK) != 0) { return; }
+    const uint64_t now = metrics_now_ns();
+    if (now < msg.rx_ns) { return; }
+    m.wire_to_match.record(now - msg.rx_ns);
+    if (m.trades.get() != trades_before) { m.wire_to_trade.record(now - msg.rx_ns); }
+}
+
+// Wait is the strategy used while the order ring is empty or the report ring is full.
+// Instantiated in match.cpp for every strategy in spsc_ring.h. When snapshot is set
+// the top of book is published whenever the ring drains, or every SNAPSHOT_EVERY.
+// With OPENING_AUCTION_NS set, orders only accumulate until that long after the
+// first message, then the book uncrosses at one price and trading goes continuous.
+// With replica set every consumed message is journaled for a standby (replica.h).
+// engine is a warm Matcher to carry on from (a standby taking over), else a fresh one.
+// gateway is a second order ring (tcp_gateway.h) and local the shared-memory client
+// slots (local_ingress.h), drained in turn with ring. Waits only watch ring, so a
+// blocking Wait picks up their orders at its timeout. gateway_reports gets a copy of
+// every report for a gateway session; when it is full the copy is dropped, the
+// matcher never waits on the gateway.
+template <typename Wait = SpinWait>
+void match_loop(OrderMsgRing& ring, ReportRing& reports, std::atomic<bool>& running,
+                MatchMetrics& metrics, BookSnapshot* snapshot = nullptr,
+                ReplicaFeed* replica = nullptr, Matcher* engine = nullptr,
+                OrderMsgRing* gateway = nullptr, LocalIngress* local = nullptr,
+                GwReportRing* gateway_reports = nullptr);
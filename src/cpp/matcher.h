@@ -0,0 +1,365 @@
+#pragma once
+
+#include <climits>
+#include "auction.h"
+#include "book_types.h"
+#include "book_snapshot.h"
+
+static constexpr size_t IDLE_COMPACT_LEVELS = 4; // per side per idle spin, keeps wake latency flat
+
+// Everything the match loop does to one message minus the rings: risk gate, book
+// update, crossing and stop elections. emit(const ExecReport&) gets one ack or
+// reject per message, ahead of any trades it causes, and one report per trade.
+template <typename Risk>
+class BasicMatcher {
+public:
+    Books book;
+    Risk risk;
+
+    explicit BasicMatcher(const RiskLimits& limits = RiskLimits{})
+        : risk(limits), auction_(PRICE_MAX - PRICE_MIN + 1) {
+        pending_.reserve(1024);
+        elected_.reserve(1024);
+    }
+
+    template <typename Emit>
+    inline void on_msg(const OrderMsg& msg, Emit&& emit) {
+        if (msg.session == CONTROL_SESSION) {
+            control(msg, emit);
+            return;
+        }
+        const RejectReason r = risk.check(msg);
+        if (r != RejectReason::None) {
+            report(emit, ExecType::Reject, r, msg);
+            return;
+        }
+        apply(msg, emit, false);
+        elect_stops(emit);
+    }
+
+    inline uint32_t last_trade_price() const { return last_px_; }
+    inline uint32_t exec_seq() const { return exec_seq_; }
+
+    // Call auction: orders are acked and rest without matching (the books may cross)
+    // until uncross().
+    inline void begin_auction() {
+        book.bids.set_accumulate(true);
+        book.asks.set_accumulate(true);
+    }
+
+    inline bool in_auction() const { return book.bids.accumulating(); }
+
+    // ends the auction: trades everything executable at one clearing price, then runs
+    // any stops that elected. Returns the volume traded.
+    template <typename Emit>
+    inline uint64_t uncross(Emit&& emit) {
+        const uint64_t vol = auction_.uncross(book.bids, book.asks, last_px_,
+            [&](uint32_t bid, uint32_t ask, uint32_t px, uint32_t qty) {
+                trade(emit, bid, ask, px, qty);
+            });
+        elect_stops(emit);
+        return vol;
+    }
+
+    // ring is empty: compact a few tombstoned levels (no-op unless CANCEL_TOMBSTONES)
+    inline void on_idle() {
+        book.bids.compact_some(IDLE_COMPACT_LEVELS);
+        book.asks.compact_some(IDLE_COMPACT_LEVELS);
+    }
+
+    inline void snapshot(BookView& v) {
+        v.exec_seq = exec_seq_;
+        v.last_trade_px = last_px_;
+        v.bid_levels = book.bids.top_levels(v.bids, SNAPSHOT_DEPTH);
+        v.ask_levels = book.asks.top_levels(v.asks, SNAPSHOT_DEPTH);
+    }
+
+private:
+    std::vector<StopOrder> pending_;  // elected, waiting to run
+    std::vector<StopOrder> elected_;  // batch being run
+    CallAuction auction_;
+    uint32_t last_px_{0};
+    uint32_t trade_lo_{UINT_MAX};     // trade range since stops were last checked
+    uint32_t trade_hi_{0};
+    uint32_t exec_seq_{0};
+
+    template <typename Emit>
+    inline void report(Emit& emit, ExecType type, RejectReason reason, const OrderMsg& msg) {
+        ExecReport r{};
+        r.exec_seq = ++exec_seq_;
+        r.client_seq = msg.seq_num;
+        r.order_id = msg.order_id;
+        r.price_tick = msg.price_tick;
+        r.qty = msg.qty;
+        r.type = type;
+        r.reason = reason;
+        r.msg_type = msg.msg_type;
+        emit(r);
+    }
+
+    template <typename Emit>
+    inline void trade(Emit& emit, uint32_t bid, uint32_t ask, uint32_t px, uint32_t qty) {
+        risk.on_fill(bid, ask, px, qty);
+        last_px_ = px;
+        if (px < trade_lo_) { trade_lo_ = px; }
+        if (px > trade_hi_) { trade_hi_ = px; }
+        ExecReport t{};
+        t.exec_seq = ++exec_seq_;
+        t.order_id = bid;
+        t.other_id = ask;
+        t.price_tick = px;
+        t.qty = qty;
+        t.type = ExecType::Trade;
+        emit(t);
+    }
+
+    // engine-internal messages (CONTROL_SESSION), e.g. from the replica journal
+    template <typename Emit>
+    inline void control(const OrderMsg& msg, Emit& emit) {
+        switch (static_cast<Control>(msg.msg_type)) {
+            case Control::Uncross:
+                uncross(emit);
+                break;
+            case Control::Bind:
+                if (msg.qty != CONTROL_SESSION && msg.qty < MAX_SESSIONS) { reset_session((uint16_t)msg.qty, emit); }
+                break;
+        }
+    }
+
+    static inline RejectReason placement_reject(const OrderMsg& msg) {
+        return (msg.order_id > MAX_ORDER_ID) ? RejectReason::OrderId : RejectReason::PriceRange;
+    }
+
+    template <typename Emit>
+    inline void apply(const OrderMsg& msg, Emit& emit, bool elected, bool market = false) {
+        const bool taker_is_buy = (msg.side == Order_Type::Buy);
+        // passive side sets the price
+        auto fill = [&](uint32_t resting_id, uint32_t px, uint32_t qty) {
+            const uint32_t bid = taker_is_buy ? msg.order_id : resting_id;
+            const uint32_t ask = taker_is_buy ? resting_id : msg.order_id;
+            trade(emit, bid, ask, px, qty);
+        };
+
+        switch (msg.msg_type) {
+            case MsgType::NewLimit:
+                if (taker_is_buy) {
+                    new_limit(book.bids, book.asks, msg, emit, fill, elected, market);
+                } 
+                else {
+                    new_limit(book.asks, book.bids, msg, emit, fill, elected, market);
+                }
+                break;
+
+            case MsgType::Cancel:
+                if (taker_is_buy) {
+                    cancel(book.bids, book.buy_stops, msg, emit);
+                } 
+                else {
+                    cancel(book.asks, book.sell_stops, msg, emit);
+                }
+                break;
+
+            case MsgType::Modify:
+                if (taker_is_buy) {
+                    modify_and_cross(book.bids, book.asks, msg, emit, fill);
+                } 
+                else {
+                    modify_and_cross(book.asks, book.bids, msg, emit, fill);
+                }
+                break;
+
+            case MsgType::NewStop:
+            case MsgType::NewStopLimit:
+                if (taker_is_buy) {
+                    new_stop(book.bids, book.buy_stops, msg, emit);
+                } 
+                else {
+                    new_stop(book.asks, book.sell_stops, msg, emit);
+                }
+                break;
+
+            case MsgType::MassCancel:
+                mass_cancel(msg, emit);
+                break;
+
+            default:
+                report(emit, ExecType::Reject, RejectReason::MsgType, msg);
+                break;
+        }
+    }
+
+    // Stops crossed by the trades just printed run as takers in a fixed order: buy
+    // stops by rising trigger, then sell stops by falling trigger, arrival order
+    // within a trigger. Their own trades can elect more, so repeat until quiet.
+    template <typename Emit>
+    inline void elect_stops(Emit& emit) {
+        while (trade_hi_ != 0 || !pending_.empty()) {
+            if (trade_hi_ != 0) {
+                book.buy_stops.release_through(trade_hi_, pending_);
+                book.sell_stops.release_through(trade_lo_, pending_);
+                trade_lo_ = UINT_MAX;
+                trade_hi_ = 0;
+            }
+            elected_.swap(pending_);
+            for (const StopOrder& s : elected_) {
+                OrderMsg m{};
+                m.order_id = s.order_id;
+                m.qty = s.qty;
+                m.msg_type = MsgType::NewLimit;
+                m.side = s.side;
+                m.session = s.session;
+                const bool market = (s.limit_tick == 0);
+                if (market) {
+                    m.price_tick = (s.side == Order_Type::Buy) ? PRICE_MAX : PRICE_MIN;
+                }
+                else {
+                    m.price_tick = s.limit_tick;
+                }
+                apply(m, emit, true, market);
+            }
+            elected_.clear();
+        }
+    }
+
+    // taker sweeps the opposite side up to its limit, the remainder rests unless
+    // it is an elected stop-market
+    template <typename Own, typename Opp, typename Fill>
+    inline void cross_and_rest(Own& own, Opp& opp, const OrderMsg& msg, Fill& fill,
+                               bool market = false) {
+        const uint32_t left = opp.sweep(msg.price_tick, msg.qty, fill);
+        if (left == 0) { return; }
+        if (market) {
+            risk.on_done(msg.order_id);
+            return;
+        }
+        own.on_new_limit(msg.order_id, msg.price_tick, left);
+    }
+
+    // elected stops were registered with risk and acked when they were placed
+    template <typename Own, typename Opp, typename Emit, typename Fill>
+    inline void new_limit(Own& own, Opp& opp, const OrderMsg& msg, Emit& emit, Fill& fill,
+                          bool elected, bool market) {
+        if (!own.accepts(msg.order_id, msg.price_tick)) {
+            if (elected) { risk.on_done(msg.order_id); }
+            else { report(emit, ExecType::Reject, placement_reject(msg), msg); }
+            return;
+        }
+        if (!elected) {
+            risk.on_new(msg);
+            report(emit, ExecType::Ack, RejectReason::None, msg);
+        }
+        cross_and_rest(own, opp, msg, fill, market);
+    }
+
+    // a stop already crossed by the last trade elects straight away
+    template <typename Own, typename Stops, typename Emit>
+    inline void new_stop(Own& own, Stops& stops, const OrderMsg& msg, Emit& emit) {
+        const bool market = (msg.msg_type == MsgType::NewStop);
+        if (!stops.accepts(msg.order_id, msg.stop_tick)
+            || (!market && !own.accepts(msg.order_id, msg.price_tick))) {
+            report(emit, ExecType::Reject, placement_reject(msg), msg);
+            return;
+        }
+        risk.on_new(msg);
+        report(emit, ExecType::Ack, RejectReason::None, msg);
+        const StopOrder stop{msg.order_id, msg.qty, market ? 0 : msg.price_tick, msg.session,
+                             msg.side};
+        // in an auction it waits for the uncross trades instead
+        if (last_px_ != 0 && !in_auction() && Stops::fires(msg.stop_tick, last_px_)) {
+            pending_.push_back(stop);
+            return;
+        }
+        stops.add(msg.stop_tick, stop);
+    }
+
+    template <typename Own, typename Stops, typename Emit>
+    inline void cancel(Own& own, Stops& stops, const OrderMsg& msg, Emit& emit) {
+        uint32_t px;
+        if (own.order_price(msg.order_id, px)) {
+            own.on_cancel(msg.order_id);
+        }
+        else if (!stops.cancel(msg.order_id)) {
+            report(emit, ExecType::Reject, RejectReason::UnknownId, msg);
+            return;
+        }
+        risk.on_done(msg.order_id);
+        report(emit, ExecType::Ack, RejectReason::None, msg);
+    }
+
+    // Every order and stop of the sender's session on the chosen sides in the price
+    // range, one bitmap pass per book and a single ack carrying the count
+    template <typename Emit>
+    inline void mass_cancel(const OrderMsg& msg, Emit& emit) {
+        const uint32_t lo = (msg.price_tick != 0) ? msg.price_tick : PRICE_MIN;
+        const uint32_t hi = (msg.stop_tick != 0) ? msg.stop_tick : PRICE_MAX;
+        if ((msg.qty & (MASS_CANCEL_BIDS | MASS_CANCEL_ASKS)) == 0) {
+            report(emit, ExecType::Reject, RejectReason::Qty, msg);
+            return;
+        }
+        if (lo > hi) {
+            report(emit, ExecType::Reject, RejectReason::PriceRange, msg);
+            return;
+        }
+        OrderMsg ack = msg;
+        ack.qty = cancel_session(msg.session, msg.qty, lo, hi);
+        report(emit, ExecType::Ack, RejectReason::None, ack);
+    }
+
+    inline uint32_t cancel_session(uint16_t session, uint32_t sides, uint32_t lo, uint32_t hi) {
+        auto mine = [&](uint32_t order_id) { return risk.owner(order_id) == session; };
+        auto my_stop = [&](const StopOrder& s) { return s.session == session; };
+        auto done = [&](uint32_t order_id) { risk.on_done(order_id); };
+        uint32_t n = 0;
+        if (sides & MASS_CANCEL_BIDS) {
+            n += book.bids.cancel_where(lo, hi, mine, done);
+            n += book.buy_stops.cancel_where(lo, hi, my_stop, done);
+        }
+        if (sides & MASS_CANCEL_ASKS) {
+            n += book.asks.cancel_where(lo, hi, mine, done);
+            n += book.sell_stops.cancel_where(lo, hi, my_stop, done);
+        }
+        return n;
+    }
+
+    // A session id going to a new client: pull what the id still has resting and
+    // zero its risk. Reports one unsolicited MassCancel ack (client_seq 0) if any went.
+    template <typename Emit>
+    inline void reset_session(uint16_t session, Emit& emit) {
+        const uint32_t n = cancel_session(session, MASS_CANCEL_BIDS | MASS_CANCEL_ASKS, PRICE_MIN, PRICE_MAX);
+        risk.reset_session(session);
+        if (n == 0) { return; }
+        OrderMsg ack{};
+        ack.msg_type = MsgType::MassCancel;
+        ack.session = session;
+        ack.qty = n;
+        report(emit, ExecType::Ack, RejectReason::None, ack);
+    }
+
+    // a price change loses priority and can cross, so it re-enters as a new limit
+    // an out-of-range new price still pulls the order, and says so in the reject
+    template <typename Own, typename Opp, typename Emit, typename Fill>
+    inline void modify_and_cross(Own& own, Opp& opp, const OrderMsg& msg, Emit& emit,
+                                 Fill& fill) {
+        uint32_t old_price;
+        if (!own.order_price(msg.order_id, old_price)) {
+            report(emit, ExecType::Reject, RejectReason::UnknownId, msg);
+            return;
+        }
+        risk.on_modify(msg.order_id, msg.qty);
+        if (old_price == msg.price_tick) {
+            own.on_modify(msg.order_id, msg.price_tick, msg.qty);
+            report(emit, ExecType::Ack, RejectReason::None, msg);
+            return;
+        }
+        own.on_cancel(msg.order_id);
+        if (!own.accepts(msg.order_id, msg.price_tick)) {
+            risk.on_done(msg.order_id);
+            report(emit, ExecType::Reject, RejectReason::PriceRange, msg);
+            return;
+        }
+        report(emit, ExecType::Ack, RejectReason::None, msg);
+        cross_and_rest(own, opp, msg, fill);
+    }
+};
+
+using Matcher = BasicMatcher<BookRisk>;
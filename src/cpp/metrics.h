@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Live engine metrics in a POSIX shm segment (/dev/shm/order_matcher_metrics).
+// Every pipeline thread owns its own cache-line-aligned block and is the only
+// writer of it, so bumping a counter is a plain load+store on a line no other
+// core writes. metrics_top (src/tools) maps the segment read-only and samples it.
+
+static constexpr const char* METRICS_SHM_NAME = "/order_matcher_metrics";
+static constexpr uint32_t METRICS_MAGIC = 0x4f4d4d54; // "OMMT"
+static constexpr uint32_t METRICS_VERSION = 10;
+
+// Single-writer counter. std::atomic only so cross-process reads are defined,
+// add() is not an RMW.
+struct Counter {
+    std::atomic<uint64_t> v{0};
+
+    inline void add(uint64_t n = 1) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    inline void set(uint64_t x) { v.store(x, std::memory_order_relaxed); }
+    inline void max(uint64_t x) {
+        if (x > v.load(std::memory_order_relaxed)) { v.store(x, std::memory_order_relaxed); }
+    }
+    inline uint64_t get() const { return v.load(std::memory_order_relaxed); }
+};
+
+// Log-linear latency histogram in ns: 4 buckets per power of two, so any value is
+// within 25% of its bucket's floor. Values past the last bucket land in it.
+static constexpr uint32_t LAT_SUB_BITS = 2;
+static constexpr uint32_t LAT_BUCKETS = 128; // last one starts at ~7.5s
+
+static inline uint32_t lat_bucket(uint64_t ns) {
+    if (ns < (1u << LAT_SUB_BITS)) { return (uint32_t)ns; }
+    const uint32_t msb = 63 - __builtin_clzll(ns);
+    const uint32_t sub = (uint32_t)(ns >> (msb - LAT_SUB_BITS)) & ((1u << LAT_SUB_BITS) - 1);
+    const uint32_t b = ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + sub;
+    return (b < LAT_BUCKETS) ? b : LAT_BUCKETS - 1;
+}
+
+// smallest ns that maps to bucket b
+static inline uint64_t lat_bucket_floor(uint32_t b) {
+    if (b < (1u << LAT_SUB_BITS)) { return b; }
+    const uint32_t msb = (b >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+    const uint64_t sub = b & ((1u << LAT_SUB_BITS) - 1);
+    return (1ull << msb) | (sub << (msb - LAT_SUB_BITS));
+}
+
+struct LatencyHist {
+    Counter buckets[LAT_BUCKETS];
+    Counter max;
+
+    inline void record(uint64_t ns) {
+        buckets[lat_bucket(ns)].add();
+        max.max(ns);
+    }
+};
+
+// how a wait strategy spent its waits (see spsc_ring.h)
+struct WaitCounters {
+    Counter spins;
+    Counter yields;
+    Counter sleeps;  // sleep_for, umwait or futex wait
+};
+
+// Hardware counters for one pipeline stage, filled by StagePerf (perf_counters.h).
+// Divide by msgs for per-message cost; all zero when the PMU isn't available.
+static constexpr int PERF_EVENTS = 5;
+static constexpr const char* PERF_EVENT_NAMES[PERF_EVENTS] = {
+    "cycles", "instr", "l1d_miss", "llc_miss", "br_miss"};
+
+struct StageCounters {
+    Counter events[PERF_EVENTS];
+    Counter msgs;
+};
+
+struct alignas(64) RecvMetrics {
+    Counter packets;      // rx descriptors consumed
+    Counter orders;       // messages pushed onto the order ring
+    Counter parse_fail;   // not IPv4/UDP to our port, or short
+    Counter dupes;        // seq already seen in its session's dedupe window
+    Counter xdp_drops;    // kernel side: rx_dropped + rx_ring_full from XDP_STATISTICS
+    Counter fq_empty;     // kernel side: fill queue ran dry
+    Counter rate_limited; // kernel side: packets over their source's rate limit (xdp_kernal.c)
+    Counter rate_limited_msgs;
+    Counter rate_sources; // kernel side: sources the rate limiter has made buckets for
+    Counter ring_depth;   // order ring occupancy at the last commit
+    Counter ring_hwm;     // highest order ring occupancy seen
+    Counter ring_full;    // batches that had to wait for ring space
+    Counter shed;         // new orders dropped by the overload policy
+    Counter nacked;       // of those, how many got an Overload reject
+    Counter fq_retry;     // fill queue reserve had to be retried
+    Counter sessions;     // session ids handed out so far
+    Counter session_full; // packets dropped because the session table was full
+    Counter session_reused; // ids taken over from an idle source by a new one
+    Counter seq_gaps;     // seqs skipped over, summed across sessions
+    Counter seq_late;     // of those, how many arrived later (reordered, not lost)
+    // A/B feed lines (feed_arb.h), all zero with one line. seq_gaps above is then
+    // what both lines lost, line_gaps what each one skipped on its own
+    Counter line_copies[2];
+    Counter line_wins[2]; // copies that were first for their seq and went to the matcher
+    Counter line_gaps[2];
+    WaitCounters wait;
+    StageCounters perf;   // per RX batch: validate, dedupe, decode, commit, recycle
+    LatencyHist line_lag[2]; // sampled, how far a losing copy trailed the winner, by losing line
+};
+
+struct alignas(64) MatchMetrics {
+    Counter msgs;
+    Counter trades;
+    Counter acks;
+    Counter rejects;
+    Counter report_depth; // report ring occupancy at the last push
+    Counter report_hwm;   // highest report ring occupancy seen
+    Counter local_msgs;   // of msgs, how many came from shared-memory clients (local_ingress.h)
+    Counter local_clients; // slots being polled at the last rescan
+    Counter gw_report_drops; // gateway sessions' reports that didn't fit the gateway's report ring
+    WaitCounters wait;
+    StageCounters perf;   // per run of messages between ring drains
+    // from XDP rx_ns (frame metadata) to the matcher being done with the message:
+    // its ack or reject, and any trades, are on the report ring. Sampled, see match.h
+    LatencyHist wire_to_match;
+    LatencyHist wire_to_trade; // same, only messages that traded
+};
+
+struct alignas(64) SendMetrics {
+    Counter reports;
+    Counter datagrams;
+    Counter send_errors;
+    WaitCounters wait;
+    StageCounters perf;   // per datagram: drain, pack, sendto
+};
+
+struct alignas(64) GatewayMetrics {
+    Counter connections;   // open right now
+    Counter accepted;
+    Counter logins;
+    Counter login_rejects; // key already logged in elsewhere, or no session ids left
+    Counter reads;         // read() calls that returned data
+    Counter orders;        // messages pushed onto the gateway ring
+    Counter dupes;         // seq below the session's next_seq (resent after a reconnect)
+    Counter seq_gaps;      // seqs skipped over, summed across sessions
+    Counter bad_frames;    // unknown type, bad length, or an order before login; closes the connection
+    Counter ring_full;     // rounds that had to wait for ring space
+    Counter reports;       // Report frames queued to connections
+    Counter reports_unrouted; // session not logged in right now, only on the UDP stream
+    Counter report_overflows; // connections closed for not reading their reports
+    WaitCounters wait;
+};
+
+struct MetricsSegment {
+    std::atomic<uint32_t> magic; // written last, readers check it
+    uint32_t version;
+    uint64_t pid;
+    uint64_t start_ns;    // CLOCK_MONOTONIC at engine start
+    alignas(64) RecvMetrics recv;
+    alignas(64) MatchMetrics match;
+    alignas(64) SendMetrics send;
+    alignas(64) GatewayMetrics gateway; // all zero when TCP_GATEWAY_PORT is 0
+};
+
+static inline uint64_t metrics_now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1'000'000'000ULL + ts.tv_nsec;
+}
+
+// engine side: create (or reset) the segment, nullptr on failure
+static inline MetricsSegment* metrics_create() {
+    int fd = shm_open(METRICS_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::perror("shm_open metrics");
+        return nullptr;
+    }
+    if (ftruncate(fd, sizeof(MetricsSegment)) != 0) {
+        std::perror("ftruncate metrics");
+        close(fd);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, sizeof(MetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        std::perror("mmap metrics");
+        return nullptr;
+    }
+    auto* seg = new (p) MetricsSegment{};
+    seg->version = METRICS_VERSION;
+    seg->pid = (uint64_t)getpid();
+    seg->start_ns = metrics_now_ns();
+    seg->magic.store(METRICS_MAGIC, std::memory_order_release);
+    return seg;
+}
+
+// reader side: map the segment read-only, nullptr if missing or a different layout
+static inline const MetricsSegment* metrics_attach() {
+    int fd = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        std::perror("shm_open metrics");
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MetricsSegment)) {
+        std::fprintf(stderr, "metrics segment too small, engine not started?\n");
+        close(fd);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, sizeof(MetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        std::perror("mmap metrics");
+        return nullptr;
+    }
+    auto* seg = static_cast<const MetricsSegment*>(p);
+    if (seg->magic.load(std::memory_order_acquire) != METRICS_MAGIC || seg->version != METRICS_VERSION) {
+        std::fprintf(stderr, "metrics segment has a different layout\n");
+        munmap(p, sizeof(MetricsSegment));
+        return nullptr;
+    }
+    return seg;
+}
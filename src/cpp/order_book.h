@@ -2,6 +2,7 @@
 
 #include <array>
 #include <cstdint>
+#include <immintrin.h>
 #include <unordered_map>
 #include <vector>
 #include "../cpp_helpers/protocols.hpp"
@@ -12,12 +13,42 @@ struct Order {
   uint32_t qty;
 };
 
+// Aggregate view of one price level
+struct LevelView {
+  uint32_t price_tick;
+  uint32_t count;
+  uint64_t qty;
+};
+
 // Where an order lives so we can cancel/modify fast
 struct info {
   uint32_t price_tick;
   uint32_t pos_in_level; // index in the vector at that price level
 };
 
+// Levels summed per step by the depth scan
+#if defined(__AVX512F__)
+static constexpr uint32_t kDepthLanes = 8;
+#else
+static constexpr uint32_t kDepthLanes = 4;
+#endif
+
+static inline uint64_t sum_depth_lanes(const uint64_t* p) {
+#if defined(__AVX512F__)
+    const __m512i v = _mm512_loadu_si512(p);
+    const __m256i h = _mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xFF, v, 0),
+                                       _mm512_maskz_extracti64x4_epi64(0xFF, v, 1));
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+    return (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi64(s, 1);
+#elif defined(__AVX2__)
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi64(s, 1);
+#else
+    return p[0] + p[1] + p[2] + p[3];
+#endif
+}
+
 
 template <Order_Type T, typename Container>
 class OrderBook {
@@ -88,13 +119,46 @@ class OrderBook {
         return true;
     }
 
-    inline Order* best_order(uint32_t& price_tick) {
+    inline const Order* best_order(uint32_t& price_tick) {
         if (book_.empty()) {return nullptr;}
         auto it = book_.begin();
         price_tick = it->first;
         return &it->second.back();
     }
 
+    inline bool accepts(uint32_t, uint32_t) const { return true; }
+
+    inline bool order_price(uint32_t order_id, uint32_t& out_price) const {
+        auto it = index_.find(order_id);
+        if (it == index_.end()) {return false;}
+        out_price = it->second.price_tick;
+        return true;
+    }
+
+    inline void fill_best(uint32_t price_tick, uint32_t qty) {
+        auto it = book_.find(price_tick);
+        if (it == book_.end()) {return;}
+        it->second.back().qty -= qty;
+        if (it->second.back().qty == 0) {remove_best(price_tick);}
+    }
+
+    // one fill at a time, same order as best_order
+    template <typename OnFill>
+    inline uint32_t sweep(uint32_t limit_price, uint32_t qty, OnFill&& on_fill) {
+        uint32_t left = qty;
+        uint32_t px;
+        while (left > 0 && !book_.empty()) {
+            const Order* o = best_order(px);
+            if constexpr (T == Order_Type::Buy) { if (px < limit_price) {break;} }
+            else { if (px > limit_price) {break;} }
+            const uint32_t f = (o->qty < left) ? o->qty : left;
+            if (f) {on_fill(o->order_id, px, f);}
+            left -= f;
+            fill_best(px, f);
+        }
+        return left;
+    }
+
     inline void remove_best(uint32_t price_tick) {
         auto it = book_.find(price_tick);
         if (it == book_.end()) {return;}
@@ -106,9 +170,16 @@ class OrderBook {
     }
 };
 
-template <Order_Type Side, uint32_t MinPrice, uint32_t MaxPrice, uint32_t MaxOrderId>
+// Tombstones = true is the cancel-heavy mode: a cancel zeroes the order in place and
+// only touches the level aggregates. Dead entries are dropped from the back when
+// matching reaches them, and levels are compacted in bulk once they are mostly dead
+// or by compact_some() in idle time. Live orders keep arrival order within a level,
+// where swap-erase moves the last order into the hole.
+template <Order_Type Side, uint32_t MinPrice, uint32_t MaxPrice, uint32_t MaxOrderId,
+          bool Tombstones = false>
 class VectorOrderBook {
     static_assert(MinPrice <= MaxPrice, "invalid price range");
+    static constexpr uint32_t kCompactMin = 16; // dead entries before a level compacts on cancel
     static constexpr uint32_t kRange = MaxPrice - MinPrice + 1;
     static constexpr uint32_t kWordBits = 64;
     static constexpr uint32_t kNumWords = (kRange + kWordBits - 1) / kWordBits;
@@ -118,6 +189,13 @@ class VectorOrderBook {
     };
 
     std::vector<Level> levels_{kRange};
+    // per-level aggregates, contiguous so the depth scan can sum them with SIMD
+    std::vector<uint64_t> level_qty_ = std::vector<uint64_t>(kRange);
+    std::vector<uint32_t> level_count_ = std::vector<uint32_t>(kRange);
+    // tombstone mode only: dead entries per level and levels waiting for compaction
+    std::vector<uint32_t> level_dead_ = std::vector<uint32_t>(Tombstones ? kRange : 0);
+    std::vector<uint8_t> level_queued_ = std::vector<uint8_t>(Tombstones ? kRange : 0);
+    std::vector<uint32_t> dirty_;
     struct IndexSlot {
         info data{};
         bool used{false};
@@ -125,6 +203,7 @@ class VectorOrderBook {
     std::vector<IndexSlot> index_{MaxOrderId + 1};
     std::array<uint64_t, kNumWords> level_bits_{}; // scan bits rather than a full arr
     bool has_best_{false};
+    bool accumulate_{false}; // auction phase: sweep matches nothing, the book may cross
     uint32_t best_price_{0};
 
 public:
@@ -171,7 +250,8 @@ private:
         }
     }
 
-    inline bool find_best_from(uint32_t start) {
+    // nearest non-empty level from start (inclusive) in priority order, bitmap only
+    inline bool scan_from(uint32_t start, uint32_t& out_price) const {
         if constexpr (Side == Order_Type::Buy) {
             uint32_t s = (start > MaxPrice) ? MaxPrice : start;
             uint32_t s_idx = idx(s);
@@ -181,16 +261,14 @@ private:
             uint64_t w = level_bits_[(size_t)word] & mask;
             if (w != 0) {
                 uint32_t pos = 63 - (uint32_t)__builtin_clzll(w); // find highest set bit
-                best_price_ = MinPrice + (uint32_t)word * kWordBits + pos;
-                has_best_ = true;
+                out_price = MinPrice + (uint32_t)word * kWordBits + pos;
                 return true;
             }
             for (--word; word >= 0; --word) { // find next non empty price level
                 w = level_bits_[(size_t)word];
                 if (w != 0) {
                     uint32_t pos = 63 - (uint32_t)__builtin_clzll(w);
-                    best_price_ = MinPrice + (uint32_t)word * kWordBits + pos;
-                    has_best_ = true;
+                    out_price = MinPrice + (uint32_t)word * kWordBits + pos;
                     return true;
                 }
             }
@@ -204,29 +282,48 @@ private:
             uint64_t w = level_bits_[word] & mask;
             if (w != 0) {
                 uint32_t pos = (uint32_t)__builtin_ctzll(w); // find highest set bit
-                best_price_ = MinPrice + word * kWordBits + pos;
-                has_best_ = true;
+                out_price = MinPrice + word * kWordBits + pos;
                 return true;
             }
             for (++word; word < kNumWords; ++word) { // find next non empty price level
                 w = level_bits_[word];
                 if (w != 0) {
                     uint32_t pos = (uint32_t)__builtin_ctzll(w);
-                    best_price_ = MinPrice + word * kWordBits + pos;
-                    has_best_ = true;
+                    out_price = MinPrice + word * kWordBits + pos;
                     return true;
                 }
             }
         }
-        has_best_ = false;
         return false;
     }
 
+    inline bool worse_than(uint32_t a, uint32_t b) const {
+        if constexpr (Side == Order_Type::Buy) { return a < b; }
+        else { return a > b; }
+    }
+
+    inline bool find_best_from(uint32_t start) {
+        has_best_ = scan_from(start, best_price_);
+        return has_best_;
+    }
+
+    // next non-empty level strictly worse than price
+    inline bool next_level_after(uint32_t price, uint32_t& out_price) const {
+        if constexpr (Side == Order_Type::Buy) {
+            return price > MinPrice && scan_from(price - 1, out_price);
+        }
+        else {
+            return price < MaxPrice && scan_from(price + 1, out_price);
+        }
+    }
+
     inline void add_to_book(uint32_t order_id, uint32_t price_tick, uint32_t qty) {
         auto& level = levels_[idx(price_tick)].orders;
         const bool was_empty = level.empty();
         const uint32_t pos = (uint32_t)level.size();
         level.push_back(Order{order_id, qty});
+        level_qty_[idx(price_tick)] += qty;
+        ++level_count_[idx(price_tick)];
         index_[order_id].data = info{price_tick, pos};
         index_[order_id].used = true;
         if (was_empty) {
@@ -252,6 +349,76 @@ private:
         has_best_ = false;
     }
 
+    // drop every dead entry of a level, keeping live order and fixing their index
+    inline void compact_level(uint32_t i) {
+        auto& level = levels_[i].orders;
+        uint32_t w = 0;
+        for (uint32_t r{}; r < level.size(); r++) {
+            if (level[r].qty == 0) { continue; }
+            if (w != r) {
+                level[w] = level[r];
+                index_[level[w].order_id].data.pos_in_level = w;
+            }
+            ++w;
+        }
+        level.resize(w);
+        level_dead_[i] = 0;
+    }
+
+    // remove the live order at the back, the level goes once nothing live is left
+    inline void pop_back_live(uint32_t price_tick) {
+        const uint32_t i = idx(price_tick);
+        auto& level = levels_[i].orders;
+        const uint32_t oid = level.back().order_id;
+        level_qty_[i] -= level.back().qty;
+        --level_count_[i];
+        level.pop_back();
+        if (valid_order_id(oid)) {
+            index_[oid].used = false;
+        }
+        if (level_count_[i] == 0) {
+            if constexpr (Tombstones) {
+                level.clear();
+                level_dead_[i] = 0;
+            }
+            clear_level_bit(price_tick);
+            refresh_best_after_remove(price_tick);
+        }
+    }
+
+    // dead entries at the back of the level, before matching looks at it
+    inline void trim_back(uint32_t i) {
+        if constexpr (Tombstones) {
+            auto& level = levels_[i].orders;
+            while (!level.empty() && level.back().qty == 0) {
+                level.pop_back();
+                --level_dead_[i];
+            }
+        }
+    }
+
+    inline void tombstone(uint32_t price, uint32_t pos) {
+        const uint32_t i = idx(price);
+        auto& level = levels_[i].orders;
+        level_qty_[i] -= level[pos].qty;
+        level[pos].qty = 0;
+        if (--level_count_[i] == 0) { // nothing live left, drop the lot
+            level.clear();
+            level_dead_[i] = 0;
+            clear_level_bit(price);
+            refresh_best_after_remove(price);
+            return;
+        }
+        ++level_dead_[i];
+        if (!level_queued_[i]) {
+            level_queued_[i] = 1;
+            dirty_.push_back(i);
+        }
+        if (level_dead_[i] >= kCompactMin && level_dead_[i] > level_count_[i]) {
+            compact_level(i);
+        }
+    }
+
     public:
 
     inline void on_new_limit(uint32_t order_id, uint32_t price_tick, uint32_t qty) {
@@ -261,6 +428,20 @@ private:
         add_to_book(order_id, price_tick, qty);
     }
 
+    // idle-time work for the tombstone mode: compact up to max_levels dirty levels,
+    // returns how many are still waiting
+    inline size_t compact_some(size_t max_levels) {
+        if constexpr (Tombstones) {
+            while (max_levels-- > 0 && !dirty_.empty()) {
+                const uint32_t i = dirty_.back();
+                dirty_.pop_back();
+                level_queued_[i] = 0;
+                if (level_dead_[i] != 0) { compact_level(i); }
+            }
+        }
+        return dirty_.size();
+    }
+
     inline void on_cancel(uint32_t order_id) {
         if (!valid_order_id(order_id)) { return; }
         auto& slot = index_[order_id];
@@ -271,8 +452,15 @@ private:
             slot.used = false; 
             return; 
         }
-        auto& level = levels_[idx(price)].orders;
         const uint32_t pos = slot.data.pos_in_level;
+        slot.used = false;
+        if constexpr (Tombstones) {
+            tombstone(price, pos);
+            return;
+        }
+        auto& level = levels_[idx(price)].orders;
+        level_qty_[idx(price)] -= level[pos].qty;
+        --level_count_[idx(price)];
 
         const uint32_t last = (uint32_t)level.size() - 1;
         if (pos != last) {
@@ -280,7 +468,6 @@ private:
             index_[level[pos].order_id].data = info{price, pos};
         }
         level.pop_back();
-        slot.used = false;
 
         if (level.empty()) {
             clear_level_bit(price);
@@ -298,8 +485,16 @@ private:
             if (!in_range(old_price)) { 
                 return; 
             }
+            if constexpr (Tombstones) {
+                if (new_qty == 0) { // qty 0 is the tombstone marker
+                    on_cancel(order_id);
+                    return;
+                }
+            }
             auto& level = levels_[idx(old_price)].orders;
-            level[slot.data.pos_in_level].qty = new_qty;
+            Order& o = level[slot.data.pos_in_level];
+            level_qty_[idx(old_price)] = level_qty_[idx(old_price)] - o.qty + new_qty;
+            o.qty = new_qty;
             return;
         }
 
@@ -311,6 +506,16 @@ private:
 
     inline const std::vector<Level>& raw_levels() const { return levels_; }
 
+    // level_qty_ from price_tick upwards, for the auction's depth prefix sums
+    inline const uint64_t* level_qty_at(uint32_t price_tick) const {
+        return level_qty_.data() + idx(price_tick);
+    }
+
+    // Accumulate-only mode for a call auction: orders rest where they are and sweep
+    // returns the qty untouched, until the auction uncrosses the book (auction.h)
+    inline void set_accumulate(bool on) { accumulate_ = on; }
+    inline bool accumulating() const { return accumulate_; }
+
     inline bool best_price(uint32_t& out_price) {
         if (!has_best_) {
             const uint32_t start = (Side == Order_Type::Buy) ? MaxPrice : MinPrice;
@@ -320,8 +525,9 @@ private:
         return true;
     }
 
-    inline Order* best_order(uint32_t& price_tick) {
+    inline const Order* best_order(uint32_t& price_tick) {
         if (!best_price(price_tick)) { return nullptr; }
+        trim_back(idx(price_tick));
         auto& level = levels_[idx(price_tick)].orders;
         if (level.empty()) {
             if (!find_best_from(price_tick)) { 
@@ -334,18 +540,208 @@ private:
 
     inline void remove_best(uint32_t price_tick) {
         if (!in_range(price_tick)) { return; }
-        auto& level = levels_[idx(price_tick)].orders;
-        if (level.empty()) { 
+        trim_back(idx(price_tick));
+        if (levels_[idx(price_tick)].orders.empty()) { 
             return; 
         }
-        const uint32_t oid = level.back().order_id;
-        level.pop_back();
-        if (valid_order_id(oid)) {
-            index_[oid].used = false;
+        pop_back_live(price_tick);
+    }
+
+    // fill the order best_order returned, dropping it once empty
+    inline void fill_best(uint32_t price_tick, uint32_t qty) {
+        if (!in_range(price_tick)) { return; }
+        trim_back(idx(price_tick));
+        auto& level = levels_[idx(price_tick)].orders;
+        if (level.empty()) { return; }
+        level.back().qty -= qty;
+        level_qty_[idx(price_tick)] -= qty;
+        if (level.back().qty == 0) {
+            pop_back_live(price_tick); // not trim_back, a filled order is not a tombstone
         }
-        if (level.empty()) {
-            clear_level_bit(price_tick);
-            refresh_best_after_remove(price_tick);
+    }
+
+    inline bool accepts(uint32_t order_id, uint32_t price_tick) const {
+        return valid_order_id(order_id) && in_range(price_tick);
+    }
+
+    inline bool order_price(uint32_t order_id, uint32_t& out_price) const {
+        if (!valid_order_id(order_id) || !index_[order_id].used) { return false; }
+        out_price = index_[order_id].data.price_tick;
+        return true;
+    }
+
+    inline uint64_t level_qty(uint32_t price_tick) const {
+        return in_range(price_tick) ? level_qty_[idx(price_tick)] : 0;
+    }
+
+    inline uint32_t level_count(uint32_t price_tick) const {
+        return in_range(price_tick) ? level_count_[idx(price_tick)] : 0;
+    }
+
+    // Cumulative resting qty from the best level through limit_price, stopping once it
+    // reaches want. stop_price is the level where want was met, or the last level in
+    // range. Sums kDepthLanes levels per step off the contiguous level_qty_ array.
+    inline uint64_t depth_within(uint32_t limit_price, uint64_t want, uint32_t& stop_price) {
+        uint32_t best;
+        if (want == 0 || !best_price(best)) { return 0; }
+        const uint64_t* q = level_qty_.data();
+        uint64_t cum = 0;
+        if constexpr (Side == Order_Type::Buy) {
+            if (best < limit_price) { return 0; }
+            const int64_t lo = (int64_t)idx(limit_price < MinPrice ? MinPrice : limit_price);
+            int64_t i = (int64_t)idx(best);
+            for (; i + 1 >= lo + (int64_t)kDepthLanes; i -= kDepthLanes) {
+                const uint64_t sum = sum_depth_lanes(q + i + 1 - kDepthLanes);
+                if (cum + sum >= want) { break; }
+                cum += sum;
+            }
+            for (; i >= lo; --i) {
+                cum += q[i];
+                if (cum >= want) {
+                    stop_price = MinPrice + (uint32_t)i;
+                    return cum;
+                }
+            }
+            stop_price = MinPrice + (uint32_t)lo;
+        }
+        else {
+            if (best > limit_price) { return 0; }
+            const uint32_t hi = idx(limit_price > MaxPrice ? MaxPrice : limit_price);
+            uint32_t i = idx(best);
+            for (; i + kDepthLanes <= hi + 1; i += kDepthLanes) {
+                const uint64_t sum = sum_depth_lanes(q + i);
+                if (cum + sum >= want) { break; }
+                cum += sum;
+            }
+            for (; i <= hi; ++i) {
+                cum += q[i];
+                if (cum >= want) {
+                    stop_price = MinPrice + i;
+                    return cum;
+                }
+            }
+            stop_price = MinPrice + hi;
+        }
+        return cum;
+    }
+
+    // best n non-empty levels in priority order, returns how many were written
+    inline uint32_t top_levels(LevelView* out, uint32_t n) {
+        uint32_t px;
+        if (n == 0 || !best_price(px)) { return 0; }
+        uint32_t k = 0;
+        do {
+            out[k++] = LevelView{px, level_count_[idx(px)], level_qty_[idx(px)]};
+        } while (k < n && next_level_after(px, px));
+        return k;
+    }
+
+    inline uint64_t depth_up_to(uint32_t limit_price) {
+        uint32_t stop;
+        return depth_within(limit_price, UINT64_MAX, stop);
+    }
+
+    // Match an aggressive order against this side up to limit_price in one pass. The depth
+    // scan bounds how deep to go, whole levels are consumed without per-order index
+    // fixups, and best price is rebuilt once at the end. on_fill(resting_id, price, qty)
+    // runs per fill, back of the level first like best_order. Returns the remainder.
+    template <typename OnFill>
+    inline uint32_t sweep(uint32_t limit_price, uint32_t qty, OnFill&& on_fill) {
+        if (accumulate_) { return qty; }
+        uint32_t stop_px;
+        if (depth_within(limit_price, qty, stop_px) == 0) { return qty; }
+        uint32_t px = best_price_;
+        uint32_t left = qty;
+        while (left > 0) {
+            const uint32_t i = idx(px);
+            auto& level = levels_[i].orders;
+            if (level_qty_[i] <= left) {
+                for (size_t k = level.size(); k-- > 0;) {
+                    const Order& o = level[k];
+                    if constexpr (Tombstones) {
+                        if (o.qty == 0) { continue; } // id may be live elsewhere by now
+                    }
+                    if (o.qty != 0) { on_fill(o.order_id, px, o.qty); }
+                    index_[o.order_id].used = false;
+                }
+                left -= (uint32_t)level_qty_[i];
+                level.clear();
+                level_qty_[i] = 0;
+                level_count_[i] = 0;
+                if constexpr (Tombstones) { level_dead_[i] = 0; }
+                clear_level_bit(px);
+                if (px == stop_px || !next_level_after(px, px)) { break; }
+                if (worse_than(px, stop_px)) { break; }
+            }
+            else {
+                while (left > 0) {
+                    trim_back(i);
+                    Order& o = level.back();
+                    const uint32_t f = (o.qty < left) ? o.qty : left;
+                    if (f != 0) { on_fill(o.order_id, px, f); }
+                    o.qty -= f;
+                    level_qty_[i] -= f;
+                    left -= f;
+                    if (o.qty == 0) {
+                        index_[o.order_id].used = false;
+                        level.pop_back();
+                        --level_count_[i];
+                    }
+                }
+                break;
+            }
+        }
+        find_best_from(px);
+        return left;
+    }
+
+    // Mass cancel: remove every order priced lo..hi that match(order_id) picks, calling
+    // on_cancel(order_id) for each. Only the set bits of level_bits_ in the range are
+    // visited, each level is compacted in one pass keeping arrival order (tombstones
+    // go too), and best price is rebuilt once at the end. Returns how many went.
+    template <typename Match, typename OnCancel>
+    inline uint32_t cancel_where(uint32_t lo, uint32_t hi, Match&& match, OnCancel&& on_cancel) {
+        if (lo < MinPrice) { lo = MinPrice; }
+        if (hi > MaxPrice) { hi = MaxPrice; }
+        if (lo > hi) { return 0; }
+        const uint32_t lo_i = idx(lo);
+        const uint32_t hi_i = idx(hi);
+        uint32_t removed = 0;
+        for (uint32_t word = lo_i / kWordBits; word <= hi_i / kWordBits; ++word) {
+            uint64_t w = level_bits_[word];
+            if (word == lo_i / kWordBits) { w &= ~0ULL << (lo_i % kWordBits); }
+            if (word == hi_i / kWordBits && hi_i % kWordBits != 63) {
+                w &= (1ULL << (hi_i % kWordBits + 1)) - 1;
+            }
+            while (w != 0) {
+                const uint32_t i = word * kWordBits + (uint32_t)__builtin_ctzll(w);
+                w &= w - 1;
+                auto& level = levels_[i].orders;
+                uint32_t kept = 0;
+                for (uint32_t r{}; r < level.size(); r++) {
+                    const Order o = level[r];
+                    if (o.qty == 0) { continue; } // tombstone, id may be live elsewhere
+                    if (match(o.order_id)) {
+                        index_[o.order_id].used = false;
+                        level_qty_[i] -= o.qty;
+                        on_cancel(o.order_id);
+                        ++removed;
+                        continue;
+                    }
+                    if (kept != r) {
+                        level[kept] = o;
+                        index_[o.order_id].data.pos_in_level = kept;
+                    }
+                    ++kept;
+                }
+                level.resize(kept);
+                level_count_[i] = kept;
+                if constexpr (Tombstones) { level_dead_[i] = 0; }
+                if (kept == 0) { clear_level_bit(MinPrice + i); }
+            }
         }
+        // removals only make the best worse, so the scan starts at the old one
+        if (removed != 0 && has_best_) { find_best_from(best_price_); }
+        return removed;
     }
 };
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <x86intrin.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "metrics.h"
+
+// Hardware counters on the calling thread, read from user space with rdpmc.
+// perf stat/record sample the whole process and smear the pinned threads into
+// each other; this attributes cycles and misses to one stage of the pipeline.
+// Needs a PMU (not there on most VMs) and perf_event_paranoid <= 2. Without one
+// open() fails and StagePerf turns into a couple of never-taken branches.
+
+static constexpr bool PERF_STAGES = true;
+static constexpr uint32_t PERF_MAX_RUN = 64; // messages per sample when a stage never idles
+
+class PerfGroup {
+    int fd_[PERF_EVENTS];
+    perf_event_mmap_page* page_[PERF_EVENTS];
+    bool rdpmc_ = false; // every event readable in user space, else group read()
+
+    static int open_event(uint32_t type, uint64_t config, int group_fd) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = (group_fd == -1); // leader starts the group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0); // this thread, any cpu
+    }
+
+    // seqlock read of one counter, see perf_event_mmap_page in linux/perf_event.h
+    static inline uint64_t read_rdpmc(const perf_event_mmap_page* pc) {
+        uint32_t seq;
+        uint64_t count;
+        do {
+            seq = __atomic_load_n(&pc->lock, __ATOMIC_ACQUIRE);
+            count = pc->offset;
+            const uint32_t idx = pc->index;
+            if (idx != 0) {
+                const int shift = 64 - pc->pmc_width;
+                int64_t pmc = (int64_t)__rdpmc(idx - 1);
+                count += (uint64_t)((pmc << shift) >> shift);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (__atomic_load_n(&pc->lock, __ATOMIC_RELAXED) != seq);
+        return count;
+    }
+
+public:
+    PerfGroup() {
+        for (int i{}; i < PERF_EVENTS; i++) {
+            fd_[i] = -1;
+            page_[i] = nullptr;
+        }
+    }
+    ~PerfGroup() { close_all(); }
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
+
+    // order matches PERF_EVENT_NAMES
+    inline bool open() {
+        const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const struct { uint32_t type; uint64_t config; } ev[PERF_EVENTS] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, l1d_read_miss},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}, // LLC on x86
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        for (int i{}; i < PERF_EVENTS; i++) {
+            fd_[i] = open_event(ev[i].type, ev[i].config, i == 0 ? -1 : fd_[0]);
+            if (fd_[i] < 0) {
+                close_all();
+                return false;
+            }
+        }
+        rdpmc_ = true;
+        const long page = sysconf(_SC_PAGESIZE);
+        for (int i{}; i < PERF_EVENTS; i++) {
+            void* p = mmap(nullptr, page, PROT_READ, MAP_SHARED, fd_[i], 0);
+            if (p == MAP_FAILED) {
+                rdpmc_ = false;
+                continue;
+            }
+            page_[i] = static_cast<perf_event_mmap_page*>(p);
+            if (!page_[i]->cap_user_rdpmc) { rdpmc_ = false; }
+        }
+        ioctl(fd_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fd_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    inline bool rdpmc() const { return rdpmc_; }
+
+    // running totals, one per event
+    inline bool read(uint64_t (&out)[PERF_EVENTS]) const {
+        if (rdpmc_) {
+            for (int i{}; i < PERF_EVENTS; i++) { out[i] = read_rdpmc(page_[i]); }
+            return true;
+        }
+        uint64_t buf[1 + PERF_EVENTS]; // PERF_FORMAT_GROUP: nr, then values
+        if (::read(fd_[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) { return false; }
+        std::memcpy(out, buf + 1, sizeof(out));
+        return true;
+    }
+
+private:
+    inline void close_all() {
+        const long page = sysconf(_SC_PAGESIZE);
+        for (int i{}; i < PERF_EVENTS; i++) {
+            if (page_[i]) { munmap(page_[i], page); }
+            if (fd_[i] >= 0) { close(fd_[i]); }
+            page_[i] = nullptr;
+            fd_[i] = -1;
+        }
+        rdpmc_ = false;
+    }
+};
+
+// Brackets one stage on the thread that constructed it: begin(), do the work,
+// end(msgs) adds the deltas and the message count to that stage's counters.
+class StagePerf {
+    PerfGroup group_;
+    StageCounters& out_;
+    uint64_t start_[PERF_EVENTS]{};
+    bool on_ = false;
+
+public:
+    explicit StagePerf(StageCounters& out) : out_(out) {
+        on_ = PERF_STAGES && group_.open();
+    }
+
+    inline bool on() const { return on_; }
+
+    inline void begin() {
+        if (on_) { group_.read(start_); }
+    }
+
+    inline void end(uint64_t msgs) {
+        if (!on_) { return; }
+        uint64_t now[PERF_EVENTS];
+        if (!group_.read(now)) { return; }
+        for (int i{}; i < PERF_EVENTS; i++) { out_.events[i].add(now[i] - start_[i]); }
+        out_.msgs.add(msgs);
+    }
+};
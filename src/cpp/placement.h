@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Where each engine thread runs, worked out from sysfs instead of fixed cpu ids.
+// The receive thread goes on the NIC's NUMA node, next to the RX queue's IRQ but
+// not on it (the softirq and the busy loop would fight for one core). Hot threads
+// each get a physical core of their own, so the matcher never shares a core with
+// its SMT sibling, and they prefer isolcpus/nohz_full cpus when there are any.
+// Stats stays on a housekeeping cpu. -1 means leave the thread unpinned.
+
+struct CpuInfo {
+    int cpu;
+    int node;       // NUMA node, 0 when the kernel has no node dirs
+    int core;       // package << 16 | core_id, equal for SMT siblings
+    bool isolated;  // in isolcpus or nohz_full
+    bool irq;       // handles the NIC queue's interrupt
+};
+
+// "0-3,8,10-11" as written by the kernel
+static inline std::vector<int> parse_cpulist(const std::string& s) {
+    std::vector<int> out;
+    std::stringstream in(s);
+    std::string part;
+    while (std::getline(in, part, ',')) {
+        if (part.empty() || part[0] == '\n') { continue; }
+        const int lo = std::atoi(part.c_str());
+        const size_t dash = part.find('-');
+        const int hi = (dash == std::string::npos) ? lo : std::atoi(part.c_str() + dash + 1);
+        for (int c = lo; c <= hi; c++) { out.push_back(c); }
+    }
+    return out;
+}
+
+static inline std::string read_line(const std::string& path) {
+    std::ifstream f(path);
+    std::string line;
+    std::getline(f, line);
+    return line;
+}
+
+static inline int read_int(const std::string& path, int fallback) {
+    const std::string s = read_line(path);
+    return s.empty() ? fallback : std::atoi(s.c_str());
+}
+
+struct Topology {
+    std::vector<CpuInfo> cpus;
+    int nic_node = -1;   // -1 when the device doesn't say (VMs, virtio)
+
+    // root prefixes /sys and /proc, so a copied tree can stand in for the real one
+    static Topology discover(const char* ifname, uint32_t queue_id, const std::string& root = "") {
+        namespace fs = std::filesystem;
+        Topology t;
+        const std::string sys = root + "/sys/devices/system";
+        std::vector<int> online = parse_cpulist(read_line(sys + "/cpu/online"));
+        if (online.empty()) {
+            const long n = sysconf(_SC_NPROCESSORS_ONLN);
+            for (int c = 0; c < n; c++) { online.push_back(c); }
+        }
+        std::vector<int> isolated = parse_cpulist(read_line(sys + "/cpu/isolated"));
+        for (const int c : parse_cpulist(read_line(sys + "/cpu/nohz_full"))) { isolated.push_back(c); }
+        const std::vector<int> irq_cpus = queue_irq_cpus(ifname, queue_id, root);
+
+        for (const int c : online) {
+            const std::string dir = sys + "/cpu/cpu" + std::to_string(c);
+            CpuInfo info{c, 0, c, false, false};
+            const int pkg = read_int(dir + "/topology/physical_package_id", 0);
+            const int core = read_int(dir + "/topology/core_id", c);
+            info.core = (pkg << 16) | core;
+            std::error_code ec;
+            for (const auto& e : fs::directory_iterator(dir, ec)) {
+                const std::string name = e.path().filename().string();
+                if (name.rfind("node", 0) == 0) { info.node = std::atoi(name.c_str() + 4); }
+            }
+            info.isolated = std::find(isolated.begin(), isolated.end(), c) != isolated.end();
+            info.irq = std::find(irq_cpus.begin(), irq_cpus.end(), c) != irq_cpus.end();
+            t.cpus.push_back(info);
+        }
+
+        t.nic_node = read_int(root + "/sys/class/net/" + ifname + "/device/numa_node", -1);
+        if (t.nic_node < 0) { // fall back to wherever the queue's IRQ lands
+            for (const CpuInfo& c : t.cpus) {
+                if (c.irq) { t.nic_node = c.node; break; }
+            }
+        }
+        return t;
+    }
+
+    inline const CpuInfo* find(int cpu) const {
+        for (const CpuInfo& c : cpus) {
+            if (c.cpu == cpu) { return &c; }
+        }
+        return nullptr;
+    }
+
+private:
+    // IRQ named after the interface and queue in /proc/interrupts (ens160-rxtx-0,
+    // eth0-TxRx-0, ...), else every MSI vector of the device; then their affinity
+    static std::vector<int> queue_irq_cpus(const char* ifname, uint32_t queue_id, const std::string& root) {
+        namespace fs = std::filesystem;
+        std::vector<int> irqs;
+        std::ifstream f(root + "/proc/interrupts");
+        const std::string suffix = "-" + std::to_string(queue_id);
+        std::string line;
+        while (std::getline(f, line)) {
+            std::stringstream in(line);
+            std::string tok;
+            in >> tok;
+            const int irq = std::atoi(tok.c_str());
+            if (tok.empty() || tok.back() != ':' || irq == 0) { continue; }
+            while (in >> tok) {
+                if (tok.rfind(ifname, 0) == 0 && tok.size() > suffix.size() &&
+                        tok.compare(tok.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                    irqs.push_back(irq);
+                    break;
+                }
+            }
+        }
+        if (irqs.empty()) {
+            std::error_code ec;
+            for (const auto& e : fs::directory_iterator(root + "/sys/class/net/" + ifname + "/device/msi_irqs", ec)) {
+                irqs.push_back(std::atoi(e.path().filename().c_str()));
+            }
+        }
+        std::vector<int> cpus;
+        for (const int irq : irqs) {
+            const std::string dir = root + "/proc/irq/" + std::to_string(irq);
+            std::string list = read_line(dir + "/effective_affinity_list");
+            if (list.empty()) { list = read_line(dir + "/smp_affinity_list"); }
+            for (const int c : parse_cpulist(list)) { cpus.push_back(c); }
+        }
+        return cpus;
+    }
+};
+
+struct Placement {
+    int recv = -1;
+    int matcher = -1;
+    int sender = -1;
+    int stats = -1;
+    int gateway = -1;
+    bool run_to_completion = false; // matcher and sender run on recv's thread
+    bool has_gateway = false;       // TCP order entry thread (tcp_gateway.h)
+
+    // hot threads in order of how much they care: recv, then matcher, then sender,
+    // then the gateway (sender is skipped when run_to_completion folds it into recv)
+    static Placement plan(const Topology& t, bool run_to_completion, bool gateway = false) {
+        Placement p;
+        p.run_to_completion = run_to_completion;
+        p.has_gateway = gateway;
+        std::vector<int> used_cores;
+        std::vector<int> irq_cores;
+        for (const CpuInfo& c : t.cpus) {
+            if (c.irq) { irq_cores.push_back(c.core); }
+        }
+        const bool have_isolated = std::any_of(t.cpus.begin(), t.cpus.end(),
+                                               [](const CpuInfo& c) { return c.isolated; });
+
+        // one cpu per physical core, lowest score wins; -1 when every core is taken
+        auto pick = [&](int want_node) {
+            int best = -1;
+            int best_score = 0;
+            for (const CpuInfo& c : t.cpus) {
+                if (std::find(used_cores.begin(), used_cores.end(), c.core) != used_cores.end()) { continue; }
+                if (c.cpu == 0 && t.cpus.size() > 1) { continue; } // cpu 0 takes the stray kernel work
+                int score = 0;
+                if (have_isolated && !c.isolated) { score += 4; }
+                if (want_node >= 0 && c.node != want_node) { score += 2; }
+                if (c.irq) { score += 1; }
+                if (std::find(irq_cores.begin(), irq_cores.end(), c.core) != irq_cores.end()) { score += 1; }
+                if (best < 0 || score < best_score) {
+                    best = c.cpu;
+                    best_score = score;
+                }
+            }
+            if (best >= 0) { used_cores.push_back(t.find(best)->core); }
+            return best;
+        };
+
+        p.recv = pick(t.nic_node);
+        const int hot_node = (p.recv >= 0) ? t.find(p.recv)->node : t.nic_node;
+        if (!run_to_completion) {
+            p.matcher = pick(hot_node); // its own core or nothing
+            p.sender = pick(hot_node);
+            if (p.sender < 0) { p.sender = sibling_of(t, p.recv, p.matcher); } // share recv's, never matcher's
+        }
+        if (gateway) { p.gateway = pick(hot_node); } // mostly in syscalls, unpinned beats sharing
+
+        // stats: not isolated and not on a hot core, else any non-isolated cpu
+        for (int pass = 0; pass < 2 && p.stats < 0; pass++) {
+            for (const CpuInfo& c : t.cpus) {
+                if (c.isolated) { continue; }
+                const bool hot = std::find(used_cores.begin(), used_cores.end(), c.core) != used_cores.end();
+                if (pass == 0 && hot) { continue; }
+                p.stats = c.cpu;
+                break;
+            }
+        }
+        return p;
+    }
+
+    void print(const Topology& t, const char* ifname, uint32_t queue_id) const {
+        std::vector<int> cores, nodes;
+        std::string isolated, irq;
+        for (const CpuInfo& c : t.cpus) {
+            if (std::find(cores.begin(), cores.end(), c.core) == cores.end()) { cores.push_back(c.core); }
+            if (std::find(nodes.begin(), nodes.end(), c.node) == nodes.end()) { nodes.push_back(c.node); }
+            if (c.isolated) { isolated += (isolated.empty() ? "" : ",") + std::to_string(c.cpu); }
+            if (c.irq) { irq += (irq.empty() ? "" : ",") + std::to_string(c.cpu); }
+        }
+        std::cout << "topology: " << t.cpus.size() << " cpus, " << cores.size() << " cores, "
+            << nodes.size() << " nodes, isolated [" << isolated << "]\n";
+        std::cout << "  " << ifname << " queue " << queue_id << ": node ";
+        if (t.nic_node < 0) { std::cout << "unknown"; } else { std::cout << t.nic_node; }
+        std::cout << ", irq on cpus [" << irq << "]\n";
+        row(t, "recv", recv);
+        if (run_to_completion) {
+            std::printf("  %-8s inline on recv\n", "matcher");
+            std::printf("  %-8s inline on recv\n", "sender");
+        }
+        else {
+            row(t, "matcher", matcher);
+            row(t, "sender", sender);
+        }
+        if (has_gateway) { row(t, "gateway", gateway); }
+        row(t, "stats", stats);
+    }
+
+private:
+    static int sibling_of(const Topology& t, int cpu, int avoid) {
+        const CpuInfo* self = t.find(cpu);
+        const CpuInfo* other = t.find(avoid);
+        if (!self) { return -1; }
+        for (const CpuInfo& c : t.cpus) {
+            if (c.cpu != cpu && c.core == self->core && (!other || c.core != other->core)) { return c.cpu; }
+        }
+        return -1;
+    }
+
+    static void row(const Topology& t, const char* label, int cpu) {
+        std::printf("  %-8s ", label);
+        const CpuInfo* c = t.find(cpu);
+        if (!c) {
+            std::printf("unpinned\n");
+            return;
+        }
+        std::string shares;
+        for (const CpuInfo& o : t.cpus) {
+            if (o.cpu != cpu && o.core == c->core) { shares += (shares.empty() ? "" : ",") + std::to_string(o.cpu); }
+        }
+        std::printf("cpu %-3d node %d core %d%s%s%s\n", cpu, c->node, c->core & 0xFFFF,
+                    shares.empty() ? "" : (" (siblings " + shares + ")").c_str(),
+                    c->isolated ? " isolated" : "", c->irq ? " irq" : "");
+    }
+};
@@ -1,60 +1,499 @@
 #pragma once
 
 #include "book_types.h"
+#include "feed_arb.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <array>
+#include <vector>
+#include <immintrin.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/if_xdp.h>
 #include <linux/if_ether.h>
 #include <linux/ip.h>
 #include <linux/udp.h>
 
-// Do this so we dont have hugeee mem overhead
-struct DedupeWindow {
-    static constexpr uint32_t W = 4096; // keep last 4096 seq nums
+// Dedupe + gap state for one session, one cache line. Bits cover the last W seqs;
+// anything older than base counts as a duplicate.
+struct alignas(64) SessionWindow {
+    static constexpr uint32_t W = 256;
     static constexpr uint32_t MASK = W - 1;
-    std::array<uint8_t, W> seen{}; // 0/1 flags
-    uint32_t base = 0; // oldest seq tracked
+    uint64_t bits[W / 64]{};
+    uint32_t base = 0;     // oldest seq tracked
+    uint32_t next = 0;     // one past the highest seq seen, 0 before the first packet
+    uint32_t gaps = 0;     // seqs skipped when the session jumped ahead
+    uint32_t late = 0;     // of those, how many turned up later inside the window
 
-    inline bool is_duplicate(uint32_t seq) {
+    inline bool test_and_set(uint32_t seq) {
+        const uint64_t bit = 1ULL << (seq & 63);
+        uint64_t& w = bits[(seq & MASK) >> 6];
+        const bool seen = (w & bit) != 0;
+        w |= bit;
+        return seen;
+    }
+
+    // unmark a seq that was let through but then not delivered (shed), so a resend
+    // of it gets in; a no-op once the window has moved past it
+    inline void forget(uint32_t seq) {
+        if (next == 0 || seq < base || seq >= base + W) { return; }
+        bits[(seq & MASK) >> 6] &= ~(1ULL << (seq & 63));
+    }
+
+    // skipped gets how many seqs this one jumped over (0 unless it is ahead)
+    inline bool is_duplicate(uint32_t seq, uint32_t& skipped) {
+        skipped = 0;
+        if (next == 0) { // first packet from this session
+            base = (seq > W - 1) ? seq - (W - 1) : 0;
+            next = seq + 1;
+            test_and_set(seq);
+            return false;
+        }
         if (seq < base) {
             return true;
         }
-
         // If seq is ahead, slide the window forward and clear old slots
         if (seq >= base + W) {
-            uint32_t new_base = seq - (W - 1);
-            for (uint32_t s = base; s < new_base; ++s) {
-                seen[s & MASK] = 0;
+            const uint32_t new_base = seq - (W - 1);
+            if (new_base - base >= W) {
+                std::memset(bits, 0, sizeof(bits));
+            }
+            else {
+                for (uint32_t s = base; s < new_base; ++s) {
+                    bits[(s & MASK) >> 6] &= ~(1ULL << (s & 63));
+                }
             }
             base = new_base;
         }
-        uint32_t idx = seq & MASK;
-        if (seen[idx]) {
+        if (test_and_set(seq)) {
             return true;
         }
-        seen[idx] = 1;
+        if (seq >= next) {
+            skipped = seq - next;
+            gaps += skipped;
+            next = seq + 1;
+        }
+        else {
+            ++late;
+        }
         return false;
     }
 };
 
+// how long a UDP session has to be quiet before a full table may give its id to a
+// new source
+static constexpr uint64_t SESSION_IDLE_NS = 60'000'000'000ULL;
+
+// Source IP + UDP port (v1) or IP + BatchHeader session (v2) -> session id, open
+// addressing over one flat array of 8-byte slots (64KB for 4096 sessions) so
+// lookups stay in L2. Ids are handed out in arrival order from 1. Once they are all
+// taken, a new source gets the id that has been quiet longest, if that is at least
+// SESSION_IDLE_NS; otherwise lookup returns 0 (table full). A new or reused id goes
+// to the matcher as a Control::Bind message ahead of the session's first order
+// (bind_msg), which starts the id clean and puts the key in the replica journal so
+// a standby can rebuild the table (restore). Slot layout:
+// bit 63 used | bits 49..62 session id | bit 48 v2 | bits 16..47 src ip | bits 0..15 port/session
+template <uint32_t MaxSessions>
+class SessionTable {
+    static constexpr uint32_t kSlots = MaxSessions * 2; // load factor <= 0.5
+    static_assert((kSlots & (kSlots - 1)) == 0, "MaxSessions must be power of two");
+    static_assert(MaxSessions <= (1u << 14), "session id is 14 bits in a slot");
+    static constexpr uint32_t kShift = 64 - __builtin_ctz(kSlots);
+    static constexpr uint64_t kUsed = 1ULL << 63;
+    static constexpr uint64_t kKeyMask = (1ULL << 49) - 1;
+
+    std::vector<uint64_t> slots_ = std::vector<uint64_t>(kSlots);
+    std::vector<SessionWindow> windows_ = std::vector<SessionWindow>(MaxSessions);
+    std::vector<OrderWire> binds_ = std::vector<OrderWire>(MaxSessions); // wire-order Bind body per id
+    std::vector<uint32_t> slot_of_ = std::vector<uint32_t>(MaxSessions); // id -> its slot
+    std::vector<uint64_t> last_ns_ = std::vector<uint64_t>(MaxSessions); // id -> last batch it was seen in
+    uint32_t count_ = 0;
+    uint64_t now_ = 0;
+    uint64_t no_idle_until_ = 0; // full table: no id can have been quiet long enough before this
+    uint64_t reused_ = 0;
+
+    static inline uint64_t make_key(uint32_t src_ip, uint16_t src_id, bool v2) {
+        return ((uint64_t)v2 << 48) | ((uint64_t)src_ip << 16) | src_id;
+    }
+
+    static inline uint32_t home(uint64_t key) { return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> kShift); }
+
+    // slot holding key, or the free slot where it would go
+    inline uint32_t find(uint64_t key) const {
+        for (uint32_t i = home(key);; i = (i + 1) & (kSlots - 1)) {
+            const uint64_t s = slots_[i];
+            if (!(s & kUsed) || (s & kKeyMask) == key) { return i; }
+        }
+    }
+
+    // backward-shift delete: pull later entries of the probe run into the hole so
+    // find never stops early at it
+    inline void erase(uint32_t i) {
+        for (uint32_t j = (i + 1) & (kSlots - 1); slots_[j] & kUsed; j = (j + 1) & (kSlots - 1)) {
+            const uint32_t h = home(slots_[j] & kKeyMask);
+            if (((j - h) & (kSlots - 1)) >= ((j - i) & (kSlots - 1))) {
+                slots_[i] = slots_[j];
+                slot_of_[(slots_[i] >> 49) & 0x3FFF] = i;
+                i = j;
+            }
+        }
+        slots_[i] = 0;
+    }
+
+    // the id quiet longest, if it has been quiet SESSION_IDLE_NS; 0 otherwise. One
+    // scan over the ids, then none until the oldest of them could qualify.
+    inline uint16_t idle_id() {
+        if (now_ < no_idle_until_) { return 0; }
+        uint16_t oldest = 1;
+        for (uint32_t id = 2; id < MaxSessions; id++) {
+            if (last_ns_[id] < last_ns_[oldest]) { oldest = (uint16_t)id; }
+        }
+        if (now_ - last_ns_[oldest] >= SESSION_IDLE_NS) { return oldest; }
+        no_idle_until_ = last_ns_[oldest] + SESSION_IDLE_NS;
+        return 0;
+    }
+
+    inline void assign(uint32_t slot, uint64_t key, uint16_t id) {
+        slots_[slot] = kUsed | ((uint64_t)id << 49) | key;
+        slot_of_[id] = slot;
+        last_ns_[id] = now_;
+        windows_[id] = SessionWindow{};
+        // Bind: order_id = src ip, price_tick = port/session, stop_tick = v2, qty = id
+        OrderWire& b = binds_[id];
+        b = OrderWire{};
+        b.order_id = htonl((uint32_t)(key >> 16));
+        b.price_tick = htonl((uint32_t)(key & 0xFFFF));
+        b.qty = htonl(id);
+        b.msg_type = static_cast<MsgType>(Control::Bind);
+        b.stop_tick = htonl((uint32_t)(key >> 48));
+    }
 
-static inline bool parse_packet(const uint8_t* frame, uint32_t frame_len, 
-        Packet& out, uint16_t udp_port) {
+    // id is bound to key from now on, dropping whatever key it had
+    inline void rebind(uint64_t key, uint16_t id) {
+        const uint32_t old = slot_of_[id];
+        if ((slots_[old] & kUsed) && ((slots_[old] >> 49) & 0x3FFF) == id) { erase(old); }
+        assign(find(key), key, id);
+    }
 
-    const uint32_t off = sizeof(ethhdr) + sizeof(iphdr) + sizeof(udphdr);
+public:
+    // once per RX batch, the time idle sessions are measured against
+    inline void tick(uint64_t now_ns) { now_ = now_ns; }
+
+    // ip and port/session as they sit in the headers, network order is fine as a key.
+    // fresh is set when the id was handed out (or reused) just now.
+    inline uint16_t lookup(uint32_t src_ip, uint16_t src_id, bool v2, bool& fresh) {
+        const uint64_t key = make_key(src_ip, src_id, v2);
+        const uint32_t i = find(key);
+        fresh = false;
+        if (slots_[i] & kUsed) {
+            const uint16_t id = (uint16_t)((slots_[i] >> 49) & 0x3FFF);
+            last_ns_[id] = now_;
+            return id;
+        }
+        if (count_ + 1 < MaxSessions) {
+            const uint16_t id = (uint16_t)++count_;
+            assign(i, key, id);
+            fresh = true;
+            return id;
+        }
+        const uint16_t id = idle_id();
+        if (id == 0) { return 0; }
+        rebind(key, id);
+        ++reused_;
+        fresh = true;
+        return id;
+    }
+
+    // the Bind for a fresh id, to go ahead of the session's first message
+    inline RxMsg bind_msg(uint16_t id) const {
+        return RxMsg{reinterpret_cast<const uint8_t*>(&binds_[id]), 0, CONTROL_SESSION,
+                     (uint8_t)offsetof(OrderWire, stop_tick), 0, 0};
+    }
+
+    // standby: a Bind read back from the journal (decoded, host order). Restored ids
+    // count as seen at the last tick.
+    inline void restore(const OrderMsg& bind) {
+        const uint16_t id = (uint16_t)bind.qty;
+        if (id == 0 || id >= MaxSessions) { return; }
+        rebind(make_key(bind.order_id, (uint16_t)bind.price_tick, bind.stop_tick != 0), id);
+        if (id > count_) { count_ = id; }
+    }
+
+    // standby taking over: every restored session counts as just seen
+    inline void touch_all() { std::fill(last_ns_.begin(), last_ns_.end(), now_); }
+
+    inline SessionWindow& window(uint16_t id) { return windows_[id]; }
+    inline uint32_t size() const { return count_; }
+    inline uint64_t reused() const { return reused_; }
+};
 
-    // check for body
-    if (frame_len < off + sizeof(Packet)) {return false;}
+static constexpr uint32_t kPayloadOff = sizeof(ethhdr) + sizeof(iphdr) + sizeof(udphdr);
 
-    const auto* payload = reinterpret_cast<const Packet*>(frame + off);
+// RxMsg::body points at order_id in both formats, so the shared fields line up
+static constexpr uint32_t kV1BodyOff = offsetof(Packet, order_id);
+static constexpr uint32_t kTypeOff = offsetof(OrderWire, msg_type);
+static_assert(offsetof(Packet, price_tick) - kV1BodyOff == offsetof(OrderWire, price_tick));
+static_assert(offsetof(Packet, qty) - kV1BodyOff == offsetof(OrderWire, qty));
+static_assert(offsetof(Packet, msg_type) - kV1BodyOff == kTypeOff);
+static_assert(offsetof(Packet, side) - kV1BodyOff == offsetof(OrderWire, side));
+static_assert(offsetof(OrderMsg, qty) == 12 && offsetof(OrderMsg, msg_type) == 16);
 
-    out.seq_num = ntohl(payload->seq_num);
-    out.order_id  = ntohl(payload->order_id);
-    out.price_tick = ntohl(payload->price_tick);
-    out.qty = ntohl(payload->qty);
-    out.msg_type = payload->msg_type;
-    out.side = payload->side;
+// xdp_kernal.c puts bpf_ktime_get_ns() in XDP metadata, which lands in the 8 bytes
+// just ahead of each frame. The kernel keeps XDP_PACKET_HEADROOM in front of every
+// RX frame, so the read stays inside the chunk; without metadata it reads 0.
+static constexpr uint32_t XDP_META_LEN = sizeof(uint64_t);
 
+static inline uint64_t frame_rx_ns(const uint8_t* frame) {
+    uint64_t ns;
+    std::memcpy(&ns, frame - XDP_META_LEN, sizeof(ns));
+    return ns;
+}
+
+// IPv4/UDP to our port (or the B line's, when set) with no IP options, else nullptr.
+// len gets the UDP payload size.
+static inline const uint8_t* frame_payload(const uint8_t* frame, uint32_t frame_len,
+        uint16_t udp_port, uint32_t& len, uint16_t udp_port_b = 0) {
+    if (frame_len < kPayloadOff + sizeof(Packet)) {return nullptr;}
+    const auto* eth = reinterpret_cast<const ethhdr*>(frame);
+    const auto* ip = reinterpret_cast<const iphdr*>(frame + sizeof(ethhdr));
+    const auto* udp = reinterpret_cast<const udphdr*>(frame + sizeof(ethhdr) + sizeof(iphdr));
+    len = (uint32_t)ntohs(udp->len) - sizeof(udphdr); // wraps huge if udp->len is short
+    const bool ok = (eth->h_proto == htons(ETH_P_IP)) & (ip->ihl == 5)
+        & (ip->protocol == IPPROTO_UDP)
+        & ((udp->dest == htons(udp_port)) | ((udp_port_b != 0) & (udp->dest == htons(udp_port_b))))
+        & (len <= frame_len - kPayloadOff);
+    return ok ? frame + kPayloadOff : nullptr;
+}
+
+// The messages in one UDP payload: entry i is at first + i*stride with seq first_seq + i
+struct PayloadView {
+    const uint8_t* first;  // order_id of entry 0
+    uint32_t first_seq;
+    uint32_t count;
+    uint32_t stride;
+    uint8_t stop_off;
+    bool v2;
+    uint16_t session;      // BatchHeader session, v2 only (network order)
+};
+
+// A v2 version byte means v2 only, with the exact length for its count; anything
+// else has to be exactly one Packet. A truncated or miscounted batch is dropped
+// rather than read as a v1 order. The version byte is the top byte of a v1 seq, so
+// v1 seqs 0x02000000..0x02FFFFFF are dropped too; v1 senders stay below that.
+static inline bool payload_view(const uint8_t* body, uint32_t len, PayloadView& v) {
+    BatchHeader h;
+    std::memcpy(&h, body, sizeof(h));
+    if (h.version == WIRE_V2) {
+        if (h.count == 0 || h.count > WIRE_V2_MAX_MSGS ||
+                len != sizeof(BatchHeader) + h.count * sizeof(OrderWire)) {return false;}
+        v = PayloadView{body + sizeof(BatchHeader), ntohl(h.first_seq), h.count, sizeof(OrderWire),
+                        (uint8_t)offsetof(OrderWire, stop_tick), true, h.session};
+        return true;
+    }
+    if (len != sizeof(Packet)) {return false;}
+    uint32_t seq;
+    std::memcpy(&seq, body, sizeof(seq));
+    v = PayloadView{body + kV1BodyOff, ntohl(seq), 1, sizeof(Packet),
+                    (uint8_t)(offsetof(Packet, stop_tick) - kV1BodyOff), false, 0};
     return true;
 }
+
+// Host-order copy of every message in the frame, up to WIRE_V2_MAX_MSGS. Returns the
+// count, 0 if the frame isn't ours or is malformed.
+static inline uint32_t parse_packet(const uint8_t* frame, uint32_t frame_len,
+        Packet* out, uint16_t udp_port) {
+
+    uint32_t len;
+    const uint8_t* body = frame_payload(frame, frame_len, udp_port, len);
+    if (!body) {return 0;}
+    PayloadView v;
+    if (!payload_view(body, len, v)) {return 0;}
+
+    for (uint32_t i{}; i < v.count; i++) {
+        const uint8_t* m = v.first + i * v.stride;
+        uint32_t w[3];
+        uint32_t stop;
+        std::memcpy(w, m, sizeof(w));
+        std::memcpy(&stop, m + v.stop_off, sizeof(stop));
+        out[i].seq_num = v.first_seq + i;
+        out[i].order_id = ntohl(w[0]);
+        out[i].price_tick = ntohl(w[1]);
+        out[i].qty = ntohl(w[2]);
+        out[i].msg_type = static_cast<MsgType>(m[kTypeOff]);
+        out[i].side = static_cast<Order_Type>(m[kTypeOff + 1]);
+        out[i].stop_tick = ntohl(stop);
+    }
+    return v.count;
+}
+
+// a frame yields up to WIRE_V2_MAX_MSGS messages, plus a Bind when its session is new
+static constexpr uint32_t RX_MSGS_PER_FRAME = WIRE_V2_MAX_MSGS + 1;
+
+// Pass 1 over an RX batch: header checks, session lookup and per-session dedupe,
+// listing the messages that survive. out needs room for rcvd * RX_MSGS_PER_FRAME.
+// desc_at(i) returns the xdp_desc for batch entry i; each frame needs XDP_META_LEN
+// readable bytes in front of it. With arb, frames to its B port are taken too and
+// the first copy of each seq from either line wins.
+template <typename DescAt, typename Sessions>
+static inline uint32_t gather_payloads(DescAt&& desc_at, uint32_t rcvd, const uint8_t* umem_area,
+        uint16_t udp_port, Sessions& sessions, RxMsg* out, RecvMetrics& m, FeedArb* arb = nullptr) {
+    uint32_t n = 0;
+    uint64_t gaps = 0;
+    uint64_t late = 0;
+    uint64_t dupes = 0;
+    sessions.tick(metrics_now_ns());
+    for (uint32_t i{}; i < rcvd; i++) {
+        const xdp_desc* d = desc_at(i);
+        const uint8_t* frame = umem_area + d->addr;
+        uint32_t len;
+        const uint8_t* body = frame_payload(frame, d->len, udp_port, len, arb ? arb->port_b() : 0);
+        PayloadView v;
+        if (!body || !payload_view(body, len, v)) {
+            m.parse_fail.add();
+            continue;
+        }
+        const auto* ip = reinterpret_cast<const iphdr*>(frame + sizeof(ethhdr));
+        const auto* udp = reinterpret_cast<const udphdr*>(frame + sizeof(ethhdr) + sizeof(iphdr));
+        bool fresh;
+        const uint16_t session = sessions.lookup(ip->saddr, v.v2 ? v.session : udp->source, v.v2, fresh);
+        if (session == 0) {
+            m.session_full.add();
+            continue;
+        }
+        if (fresh) {
+            out[n++] = sessions.bind_msg(session);
+            if (arb) { arb->reset(session); }
+        }
+        SessionWindow& w = sessions.window(session);
+        const uint32_t late_before = w.late;
+        const uint64_t rx_ns = frame_rx_ns(frame);
+        const uint32_t line = arb ? arb->line(udp->dest) : 0;
+        for (uint32_t k{}; k < v.count; k++) {
+            const uint32_t seq = v.first_seq + k;
+            uint32_t skipped;
+            const bool seen = w.is_duplicate(seq, skipped);
+            // with two lines a seen seq is usually the other line's copy, not a dupe
+            const bool repeat = arb ? arb->on_copy(session, line, seq, seen, rx_ns, m) : seen;
+            if (seen) {
+                dupes += repeat;
+                continue;
+            }
+            gaps += skipped;
+            out[n++] = RxMsg{v.first + k * v.stride, seq, session, v.stop_off, 0, rx_ns};
+        }
+        late += w.late - late_before;
+    }
+    m.packets.add(rcvd);
+    if (arb) { arb->publish(m); }
+    if (dupes) { m.dupes.add(dupes); }
+    if (gaps) { m.seq_gaps.add(gaps); }
+    if (late) { m.seq_late.add(late); }
+    m.sessions.set(sessions.size());
+    m.session_reused.set(sessions.reused());
+    return n;
+}
+
+// What the receive loop does once the order ring is past its high-water mark.
+// Block: wait for the matcher, RX backs up and the kernel drops (xdp_drops).
+// Shed: drop new orders and modifies, cancels still go through.
+// Nack: like Shed, and tell the client with an Overload reject.
+enum class OverloadPolicy : uint8_t { Block, Shed, Nack };
+
+// Compacts msgs down to the cancels, mass cancels and control messages, moving the
+// rest to shed.
+// Returns the number kept; order among the kept messages is unchanged.
+static inline uint32_t keep_cancels(RxMsg* msgs, uint32_t n, RxMsg* shed, uint32_t& n_shed) {
+    uint32_t kept = 0;
+    n_shed = 0;
+    for (uint32_t i{}; i < n; i++) {
+        const MsgType t = static_cast<MsgType>(msgs[i].body[kTypeOff]);
+        if (t == MsgType::Cancel || t == MsgType::MassCancel || msgs[i].session == CONTROL_SESSION) {
+            msgs[kept++] = msgs[i];
+        } else {
+            shed[n_shed++] = msgs[i];
+        }
+    }
+    return kept;
+}
+
+// Shed messages already went through the dedupe windows; clear them there so the
+// client can resend them with the same seqs.
+template <typename Sessions>
+static inline void forget_shed(Sessions& sessions, const RxMsg* shed, uint32_t n_shed) {
+    for (uint32_t i{}; i < n_shed; i++) {
+        sessions.window(shed[i].session).forget(shed[i].seq);
+    }
+}
+
+// swapped holds order_id, price_tick, qty in lanes 1..3 with lane 0 zero, seq goes there
+static inline void store_payload(OrderMsg* slot, const RxMsg& m, __m128i swapped) {
+    swapped = _mm_or_si128(swapped, _mm_cvtsi32_si128((int)m.seq));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(slot), swapped);
+    uint32_t stop;
+    std::memcpy(&stop, m.body + m.stop_off, sizeof(stop));
+    slot->msg_type = static_cast<MsgType>(m.body[kTypeOff]);
+    slot->side = static_cast<Order_Type>(m.body[kTypeOff + 1]);
+    slot->session = m.session;
+    slot->stop_tick = ntohl(stop);
+    slot->rx_ns = m.rx_ns;
+}
+
+// Pass 2: byte-swap n messages into the n slots already reserved on the ring.
+// One shuffle swaps order_id/price/qty and shifts them up a lane, making room for
+// the seq. AVX-512 does 4 messages per shuffle, AVX2 2, SSSE3 1, else scalar ntohl.
+template <typename Ring>
+static inline void decode_payloads(const RxMsg* msgs, uint32_t n, Ring& ring) {
+    uint32_t i = 0;
+#if defined(__SSSE3__)
+    const __m128i swap = _mm_setr_epi8(-1, -1, -1, -1, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8);
+    auto load = [](const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+#endif
+#if defined(__AVX512BW__)
+    const __m512i swap4 = _mm512_maskz_broadcast_i32x4(0xFFFF, swap);
+    for (; i + 4 <= n; i += 4) {
+        __m512i v = _mm512_zextsi128_si512(load(msgs[i].body));
+        v = _mm512_inserti32x4(v, load(msgs[i + 1].body), 1);
+        v = _mm512_inserti32x4(v, load(msgs[i + 2].body), 2);
+        v = _mm512_inserti32x4(v, load(msgs[i + 3].body), 3);
+        v = _mm512_shuffle_epi8(v, swap4);
+        store_payload(ring.producer_slot(i), msgs[i], _mm512_maskz_extracti32x4_epi32(0xF, v, 0));
+        store_payload(ring.producer_slot(i + 1), msgs[i + 1], _mm512_maskz_extracti32x4_epi32(0xF, v, 1));
+        store_payload(ring.producer_slot(i + 2), msgs[i + 2], _mm512_maskz_extracti32x4_epi32(0xF, v, 2));
+        store_payload(ring.producer_slot(i + 3), msgs[i + 3], _mm512_maskz_extracti32x4_epi32(0xF, v, 3));
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256i swap2 = _mm256_broadcastsi128_si256(swap);
+    for (; i + 2 <= n; i += 2) {
+        __m256i v = _mm256_set_m128i(load(msgs[i + 1].body), load(msgs[i].body));
+        v = _mm256_shuffle_epi8(v, swap2);
+        store_payload(ring.producer_slot(i), msgs[i], _mm256_castsi256_si128(v));
+        store_payload(ring.producer_slot(i + 1), msgs[i + 1], _mm256_extracti128_si256(v, 1));
+    }
+#endif
+#if defined(__SSSE3__)
+    for (; i < n; ++i) {
+        store_payload(ring.producer_slot(i), msgs[i], _mm_shuffle_epi8(load(msgs[i].body), swap));
+    }
+#else
+    for (; i < n; ++i) {
+        const RxMsg& m = msgs[i];
+        uint32_t w[3];
+        uint32_t stop;
+        std::memcpy(w, m.body, sizeof(w));
+        std::memcpy(&stop, m.body + m.stop_off, sizeof(stop));
+        OrderMsg* slot = ring.producer_slot(i);
+        slot->seq_num = m.seq;
+        slot->order_id = ntohl(w[0]);
+        slot->price_tick = ntohl(w[1]);
+        slot->qty = ntohl(w[2]);
+        slot->msg_type = static_cast<MsgType>(m.body[kTypeOff]);
+        slot->side = static_cast<Order_Type>(m.body[kTypeOff + 1]);
+        slot->session = m.session;
+        slot->stop_tick = ntohl(stop);
+        slot->rx_ns = m.rx_ns;
+    }
+#endif
+}
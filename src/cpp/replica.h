@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../cpp_helpers/protocols.hpp"
+
+// Hot standby. The primary's matcher appends every OrderMsg it consumes, in the
+// order it consumed them, to a journal in shared memory (/dev/shm/order_matcher_replica)
+// along with its exec_seq and a running hash of its trades after that message.
+// A standby engine (xdp_recv --standby) replays the journal through its own
+// Matcher and checks both after every record. The matcher is deterministic, so
+// any difference means the two books have split. Work the matcher does on its
+// own, like the auction uncross, is journaled as a control message (CONTROL_SESSION).
+// Once the primary process is gone the standby's book is already current and it
+// starts up as the primary.
+//
+// The primary never waits on the standby. A record is one 32-byte streaming store
+// into the next slot, and the write index the standby polls is only published
+// when the order ring drains or every REPLICA_PUBLISH_EVERY records, so that
+// line changes hands at most that often. A standby that falls a whole journal
+// behind has lost records and stops.
+//
+// There is no book snapshot to start from, so a standby replays from record 0 and
+// can only join before the journal's first wrap (REPLICA_RECORDS messages): start
+// it with the primary. replica_attach refuses a journal that has already wrapped.
+// A standby that takes over doesn't journal either, since a new standby would
+// replay into an empty book. After a failover, restart the pair to get a standby
+// back.
+//
+// The cost is a crash window: if the primary dies without running ~ReplicaFeed,
+// the records after the last publish (up to REPLICA_PUBLISH_EVERY - 1) never reach
+// the standby, though their reports may already have gone out. The standby takes
+// over from the last published record, and a client resending one of those
+// messages gets it matched again. A clean shutdown publishes everything, clears
+// magic and unlinks the segment; a crashed primary's segment is left behind, and
+// replica_attach skips it once its pid is gone.
+
+static constexpr const char* REPLICA_SHM_NAME = "/order_matcher_replica";
+static constexpr uint32_t REPLICA_MAGIC = 0x4f4d5250; // "OMRP"
+static constexpr uint32_t REPLICA_VERSION = 2;
+static constexpr uint32_t REPLICA_RECORDS = 1u << 22;  // 128MB, the standby must attach before the first wrap
+static constexpr uint32_t REPLICA_PUBLISH_EVERY = 64;
+static_assert((REPLICA_RECORDS & (REPLICA_RECORDS - 1)) == 0, "power of 2");
+
+// OrderMsg up to rx_ns, which the standby has no use for, then the check values
+static constexpr uint32_t REPLICA_MSG_BYTES = offsetof(OrderMsg, rx_ns);
+struct ReplicaRecord {
+    uint8_t msg[REPLICA_MSG_BYTES];
+    uint32_t exec_seq;    // primary's exec_seq after this record
+    uint32_t trade_hash;  // over every trade up to and including this record's
+};
+static_assert(sizeof(ReplicaRecord) == 32, "two records per cache line");
+
+struct ReplicaSegment {
+    std::atomic<uint32_t> magic; // written last, readers check it
+    uint32_t version;
+    uint64_t pid;                // primary, the standby takes over once it is gone
+    alignas(64) std::atomic<uint64_t> written; // records published so far
+    std::atomic<uint32_t> closed;              // primary shut down
+    alignas(64) ReplicaRecord records[REPLICA_RECORDS];
+};
+
+static inline uint32_t replica_hash(uint32_t h, const ExecReport& r) {
+#if defined(__SSE4_2__)
+    h = _mm_crc32_u32(h, r.exec_seq);
+    h = _mm_crc32_u32(h, r.order_id);
+    h = _mm_crc32_u32(h, r.other_id);
+    h = _mm_crc32_u32(h, r.price_tick);
+    return _mm_crc32_u32(h, r.qty);
+#else
+    for (const uint32_t v : {r.exec_seq, r.order_id, r.other_id, r.price_tick, r.qty}) {
+        h = (h ^ v) * 16777619u; // FNV-1a per word
+    }
+    return h;
+#endif
+}
+
+// Primary side, owned by the matcher thread. on() is false when the segment could
+// not be created; the engine then runs without a standby.
+class ReplicaFeed {
+    const char* name_;
+    ReplicaSegment* seg_ = nullptr;
+    uint64_t next_ = 0;
+    uint64_t published_ = 0;
+    uint32_t hash_ = 0;
+
+public:
+    explicit ReplicaFeed(const char* name = REPLICA_SHM_NAME) : name_(name) {
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            std::perror("shm_open replica");
+            return;
+        }
+        if (ftruncate(fd, sizeof(ReplicaSegment)) != 0) {
+            std::perror("ftruncate replica");
+            close(fd);
+            return;
+        }
+        // populate up front, a first touch would otherwise page fault on the matcher
+        void* p = mmap(nullptr, sizeof(ReplicaSegment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            std::perror("mmap replica");
+            return;
+        }
+        seg_ = static_cast<ReplicaSegment*>(p);
+        seg_->magic.store(0, std::memory_order_relaxed);
+        seg_->version = REPLICA_VERSION;
+        seg_->pid = (uint64_t)getpid();
+        seg_->written.store(0, std::memory_order_relaxed);
+        seg_->closed.store(0, std::memory_order_relaxed);
+        seg_->magic.store(REPLICA_MAGIC, std::memory_order_release);
+    }
+    ~ReplicaFeed() {
+        if (!seg_) { return; }
+        publish();
+        seg_->closed.store(1, std::memory_order_release);
+        // a following standby keeps its mapping and sees closed; nobody new attaches
+        seg_->magic.store(0, std::memory_order_release);
+        munmap(seg_, sizeof(ReplicaSegment));
+        shm_unlink(name_);
+    }
+    ReplicaFeed(const ReplicaFeed&) = delete;
+    ReplicaFeed& operator=(const ReplicaFeed&) = delete;
+
+    inline bool on() const { return seg_ != nullptr; }
+
+    // every report the matcher emits, before the append for its message
+    inline void on_report(const ExecReport& r) {
+        if (r.type == ExecType::Trade) { hash_ = replica_hash(hash_, r); }
+    }
+
+    inline void append(const OrderMsg& msg, uint32_t exec_seq) {
+        static_assert(sizeof(OrderMsg) == sizeof(ReplicaRecord), "rx_ns swaps for the check values");
+        ReplicaRecord* slot = &seg_->records[next_ & (REPLICA_RECORDS - 1)];
+        const uint64_t check = ((uint64_t)hash_ << 32) | exec_seq;
+#if defined(__AVX2__)
+        // non-temporal: the journal is far bigger than the cache, a normal store
+        // would read each line in from memory first and evict the books for it
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&msg));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(slot), _mm256_insert_epi64(v, (long long)check, 3));
+#else
+        std::memcpy(slot->msg, &msg, REPLICA_MSG_BYTES);
+        std::memcpy(&slot->exec_seq, &check, sizeof(check));
+#endif
+        if (++next_ - published_ >= REPLICA_PUBLISH_EVERY) { publish(); }
+    }
+
+    inline void append_uncross(uint32_t exec_seq) {
+        OrderMsg m{};
+        m.session = CONTROL_SESSION; // replays as Matcher::uncross
+        m.msg_type = static_cast<MsgType>(Control::Uncross);
+        append(m, exec_seq);
+    }
+
+    inline void publish() {
+        if (next_ == published_) { return; }
+        _mm_sfence(); // streamed records are visible before the index that covers them
+        seg_->written.store(next_, std::memory_order_release);
+        published_ = next_;
+    }
+};
+
+// standby side: map the primary's segment read-only, nullptr if it isn't there yet
+// or its primary is already gone (closed, or a crashed primary's leftover). Also
+// nullptr, with wrapped set, when the journal has already lapped record 0, which a
+// late standby can never catch up from.
+static inline const ReplicaSegment* replica_attach(const char* name = REPLICA_SHM_NAME,
+                                                   bool* wrapped = nullptr) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) { return nullptr; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ReplicaSegment)) {
+        close(fd);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, sizeof(ReplicaSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        std::perror("mmap replica");
+        return nullptr;
+    }
+    auto* seg = static_cast<const ReplicaSegment*>(p);
+    if (seg->magic.load(std::memory_order_acquire) != REPLICA_MAGIC || seg->version != REPLICA_VERSION ||
+            seg->closed.load(std::memory_order_acquire) || (kill((pid_t)seg->pid, 0) != 0 && errno == ESRCH)) {
+        munmap(p, sizeof(ReplicaSegment));
+        return nullptr;
+    }
+    if (seg->written.load(std::memory_order_acquire) > REPLICA_RECORDS) {
+        if (wrapped) { *wrapped = true; }
+        munmap(p, sizeof(ReplicaSegment));
+        return nullptr;
+    }
+    return seg;
+}
+
+enum class FollowEnd : uint8_t { PrimaryGone, Diverged, Overrun, Stopped };
+
+// Replays the journal into engine until the primary exits (or closes the segment).
+// applied counts the records replayed; on Diverged the last one is where the
+// exec_seq or trade hash first differed. on_record(const OrderMsg&) sees every
+// record after it is applied, for rebuilding the ingress session tables.
+template <typename Engine, typename OnRecord>
+static FollowEnd replica_follow(const ReplicaSegment* seg, Engine& engine, const std::atomic<bool>& running,
+                                uint64_t& applied, OnRecord&& on_record) {
+    uint32_t hash = 0;
+    auto emit = [&](const ExecReport& r) {
+        if (r.type == ExecType::Trade) { hash = replica_hash(hash, r); }
+    };
+    uint32_t idle = 0;
+    applied = 0;
+    while (running.load(std::memory_order_acquire)) {
+        const uint64_t written = seg->written.load(std::memory_order_acquire);
+        if (written == applied) {
+            if (seg->closed.load(std::memory_order_acquire)) { return FollowEnd::PrimaryGone; }
+            if (++idle % 4096 == 0 && kill((pid_t)seg->pid, 0) != 0 && errno == ESRCH) {
+                return FollowEnd::PrimaryGone;
+            }
+            _mm_pause();
+            continue;
+        }
+        idle = 0;
+        const uint64_t start = applied;
+        if (written - start > REPLICA_RECORDS) { return FollowEnd::Overrun; }
+        for (; applied < written; ++applied) {
+            const ReplicaRecord rec = seg->records[applied & (REPLICA_RECORDS - 1)];
+            OrderMsg msg{};
+            std::memcpy(&msg, rec.msg, REPLICA_MSG_BYTES);
+            engine.on_msg(msg, emit); // control records (uncross) included
+            if (engine.exec_seq() != rec.exec_seq || hash != rec.trade_hash) {
+                ++applied;
+                const bool lapped = seg->written.load(std::memory_order_acquire) - start > REPLICA_RECORDS;
+                return lapped ? FollowEnd::Overrun : FollowEnd::Diverged;
+            }
+            on_record(msg);
+        }
+        // the primary may have lapped the slots while they were being copied
+        if (seg->written.load(std::memory_order_acquire) - start > REPLICA_RECORDS) { return FollowEnd::Overrun; }
+    }
+    return FollowEnd::Stopped;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../cpp_helpers/protocols.hpp"
+
+struct RiskLimits {
+    uint32_t price_band = 1000;          // max ticks away from the last trade
+    uint32_t max_qty = 10000;
+    uint64_t max_notional = 50'000'000;  // price_tick * qty
+    uint32_t max_open_orders = 50000;    // per session
+    int64_t max_position = 1'000'000;    // per session, net filled qty either way
+};
+
+// Pre-trade checks ahead of the book. All state lives in flat tables sized up front,
+// so a check is a few compares plus one session entry, and fills touch two owners.
+template <uint32_t MaxSessions, uint32_t MaxOrderId>
+class RiskGate {
+    struct SessionRisk {
+        int64_t position;
+        uint32_t open_orders;
+        uint32_t pad;
+    };
+
+    RiskLimits limits_;
+    uint32_t last_trade_px_{0}; // no band until the first trade
+    uint64_t rejects_{0};
+    std::vector<SessionRisk> sessions_ = std::vector<SessionRisk>(MaxSessions);
+    std::vector<uint32_t> live_qty_ = std::vector<uint32_t>(MaxOrderId + 1); // open qty per id
+    std::vector<uint16_t> owner_ = std::vector<uint16_t>(MaxOrderId + 1);    // session per id
+
+    inline RejectReason evaluate(const OrderMsg& msg) const {
+        if (msg.session >= MaxSessions) { return RejectReason::Session; }
+        if (msg.qty == 0 || msg.qty > limits_.max_qty) { return RejectReason::Qty; }
+        // stop-market has no limit, so it is judged at its trigger
+        const uint32_t px = (msg.msg_type == MsgType::NewStop) ? msg.stop_tick : msg.price_tick;
+        if ((uint64_t)px * msg.qty > limits_.max_notional) { return RejectReason::Notional; }
+        if (last_trade_px_ != 0) {
+            const uint32_t diff = (px > last_trade_px_) ? px - last_trade_px_ : last_trade_px_ - px;
+            if (diff > limits_.price_band) { return RejectReason::PriceBand; }
+        }
+        const SessionRisk& s = sessions_[msg.session];
+        if (msg.msg_type != MsgType::Modify) {
+            if (msg.order_id <= MaxOrderId && live_qty_[msg.order_id] != 0) {
+                return RejectReason::DuplicateId;
+            }
+            if (s.open_orders >= limits_.max_open_orders) { return RejectReason::OpenOrders; }
+        }
+        // worst case is this order filling in full
+        const int64_t after = (msg.side == Order_Type::Buy)
+            ? s.position + msg.qty : s.position - (int64_t)msg.qty;
+        if (after > limits_.max_position || after < -limits_.max_position) {
+            return RejectReason::Position;
+        }
+        return RejectReason::None;
+    }
+
+    inline void reduce(uint32_t order_id, uint32_t qty) {
+        uint32_t& live = live_qty_[order_id];
+        if (live == 0) { return; }
+        live = (qty < live) ? live - qty : 0;
+        if (live == 0) { --sessions_[owner_[order_id]].open_orders; }
+    }
+
+public:
+    explicit RiskGate(const RiskLimits& limits = RiskLimits{}) : limits_(limits) {}
+
+    // cancels and mass cancels always pass, everything else is checked against the limits
+    inline RejectReason check(const OrderMsg& msg) {
+        if (msg.msg_type == MsgType::Cancel || msg.msg_type == MsgType::MassCancel) {
+            return RejectReason::None;
+        }
+        const RejectReason r = evaluate(msg);
+        if (r != RejectReason::None) { ++rejects_; }
+        return r;
+    }
+
+    // hooks the matcher calls once the book has accepted the change
+    inline void on_new(const OrderMsg& msg) {
+        live_qty_[msg.order_id] = msg.qty;
+        owner_[msg.order_id] = msg.session;
+        ++sessions_[msg.session].open_orders;
+    }
+
+    inline void on_modify(uint32_t order_id, uint32_t new_qty) {
+        if (live_qty_[order_id] != 0) { live_qty_[order_id] = new_qty; }
+    }
+
+    inline void on_done(uint32_t order_id) {
+        if (live_qty_[order_id] == 0) { return; }
+        live_qty_[order_id] = 0;
+        --sessions_[owner_[order_id]].open_orders;
+    }
+
+    inline void on_fill(uint32_t bid_id, uint32_t ask_id, uint32_t price_tick, uint32_t qty) {
+        last_trade_px_ = price_tick;
+        sessions_[owner_[bid_id]].position += qty;
+        sessions_[owner_[ask_id]].position -= qty;
+        reduce(bid_id, qty);
+        reduce(ask_id, qty);
+    }
+
+    // the id is going to a new client; its orders are already gone
+    inline void reset_session(uint16_t session) { sessions_[session] = SessionRisk{}; }
+
+    inline uint32_t last_trade_price() const { return last_trade_px_; }
+    inline uint64_t rejects() const { return rejects_; }
+    inline int64_t position(uint16_t session) const { return sessions_[session].position; }
+    inline uint32_t open_orders(uint16_t session) const { return sessions_[session].open_orders; }
+    inline uint16_t owner(uint32_t order_id) const { return owner_[order_id]; } // session that placed it
+};
+
+// Same hooks with no checks, for benchmarking the gate and for trusted flow
+struct NoRisk {
+    explicit NoRisk(const RiskLimits&) {}
+    inline RejectReason check(const OrderMsg&) { return RejectReason::None; }
+    inline void on_new(const OrderMsg&) {}
+    inline void on_modify(uint32_t, uint32_t) {}
+    inline void on_done(uint32_t) {}
+    inline void on_fill(uint32_t, uint32_t, uint32_t, uint32_t) {}
+    inline void reset_session(uint16_t) {}
+    inline uint16_t owner(uint32_t) const { return 0; } // untracked, a mass cancel from session 0 takes all
+};
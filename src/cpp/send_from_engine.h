@@ -1,30 +1,135 @@
 #pragma once
 
 #include "match.h"
+#include "metrics.h"
+#include "perf_counters.h"
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <thread>
+#include <cstddef>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <atomic>
 
-struct TradeWire {
-    uint32_t bid_order_id;
-    uint32_t ask_order_id;
-    uint32_t price_tick;
-    uint32_t qty;
+// reports per datagram, keeps each send inside a 1500 byte MTU
+static constexpr uint32_t REPORTS_PER_DATAGRAM = 48;
+
+static inline ReportWire to_wire(const ExecReport& r) {
+    return ReportWire{
+        htonl(r.exec_seq),
+        htonl(r.client_seq),
+        htonl(r.order_id),
+        htonl(r.other_id),
+        htonl(r.price_tick),
+        htonl(r.qty),
+        r.type,
+        r.reason,
+        r.msg_type,
+        0
+    };
+}
+
+// Packs reports into datagrams on the calling thread, for the run-to-completion
+// layout where there is no report ring or sender thread. push() sends once a
+// datagram is full, flush() sends whatever is left at the end of an RX batch.
+class ReportBatcher {
+    int fd_ = -1;
+    sockaddr_in addr_{};
+    SendMetrics& metrics_;
+    ReportWire batch_[REPORTS_PER_DATAGRAM];
+    uint32_t n_ = 0;
+
+public:
+    ReportBatcher(const char* dst_ip, uint16_t dst_port, SendMetrics& metrics) : metrics_(metrics) {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd_ < 0) {
+            std::perror("report socket");
+            std::exit(1);
+        }
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(dst_port);
+        if (inet_pton(AF_INET, dst_ip, &addr_.sin_addr) != 1) {
+            std::cerr << "invalid dst_ip\n";
+            std::exit(1);
+        }
+    }
+    ~ReportBatcher() { close(fd_); }
+    ReportBatcher(const ReportBatcher&) = delete;
+    ReportBatcher& operator=(const ReportBatcher&) = delete;
+
+    inline void push(const ExecReport& r) {
+        batch_[n_++] = to_wire(r);
+        if (n_ == REPORTS_PER_DATAGRAM) { flush(); }
+    }
+
+    inline void flush() {
+        if (n_ == 0) { return; }
+        const ssize_t sent = sendto(fd_, batch_, n_ * sizeof(ReportWire), 0,
+                                    reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_));
+        metrics_.reports.add(n_);
+        if (sent < 0) {
+            metrics_.send_errors.add();
+        } else {
+            metrics_.datagrams.add();
+        }
+        n_ = 0;
+    }
 };
 
-inline std::thread start_trade_sender(TradeMsgRing& trades, const char* dst_ip, 
-        uint16_t dst_port, std::atomic<bool>& running) {
+// Overload rejects straight from the receive thread on its own socket, so shedding
+// never touches the rings. They carry exec_seq 0: they are not part of the
+// engine-sequenced stream, the message never reached the matcher.
+class NackSender {
+    int fd_ = -1;
+    sockaddr_in addr_{};
+
+public:
+    NackSender(const char* dst_ip, uint16_t dst_port) {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd_ < 0) {
+            std::perror("nack socket");
+            std::exit(1);
+        }
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(dst_port);
+        if (inet_pton(AF_INET, dst_ip, &addr_.sin_addr) != 1) {
+            std::cerr << "invalid dst_ip\n";
+            std::exit(1);
+        }
+    }
+    ~NackSender() { close(fd_); }
+    NackSender(const NackSender&) = delete;
+    NackSender& operator=(const NackSender&) = delete;
+
+    // msg bodies are still in network order like ReportWire, only seq is host order
+    inline void send(const RxMsg* msgs, uint32_t n) {
+        ReportWire batch[REPORTS_PER_DATAGRAM];
+        uint32_t k = 0;
+        for (uint32_t i{}; i < n; i++) {
+            OrderWire w; // v1 and v2 bodies agree up to side
+            std::memcpy(&w, msgs[i].body, offsetof(OrderWire, pad));
+            batch[k++] = ReportWire{0, htonl(msgs[i].seq), w.order_id, 0, w.price_tick, w.qty,
+                                    ExecType::Reject, RejectReason::Overload, w.msg_type, 0};
+            if (k == REPORTS_PER_DATAGRAM || i + 1 == n) {
+                (void)sendto(fd_, batch, k * sizeof(ReportWire), 0,
+                             reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_));
+                k = 0;
+            }
+        }
+    }
+};
+
+template <typename Wait = SpinWait>
+inline std::thread start_report_sender(ReportRing& reports, const char* dst_ip, 
+        uint16_t dst_port, std::atomic<bool>& running, SendMetrics& metrics) {
 
     int fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (fd < 0) {
-        std::perror("trade sender socket");
+        std::perror("report sender socket");
         std::exit(1);
     }
 
@@ -36,29 +141,38 @@ inline std::thread start_trade_sender(TradeMsgRing& trades, const char* dst_ip,
         std::exit(1);
     }
 
-    // return a thread that reads from the meatched ring and sends out trades
-    return std::thread([fd, addr, &trades, &running]() mutable {
-        SpinWait wait;
+    // return a thread that drains the report ring and sends whatever has built up
+    // as one datagram, so acks ride along with trades for free
+    return std::thread([fd, addr, &reports, &running, &metrics]() mutable {
+        Wait wait;
+        wait.stats = &metrics.wait;
+        StagePerf perf(metrics.perf);
+        ReportWire batch[REPORTS_PER_DATAGRAM];
         while (running.load(std::memory_order_acquire)) {
-            TradeMsg* slot = nullptr;
-            while (!trades.try_acquire_consumer_slot(slot)) {
+            ExecReport* slot = nullptr;
+            while (!reports.try_acquire_consumer_slot(slot)) {
                 if (!running.load(std::memory_order_acquire)) { break; }
-                wait.pause();
+                wait.pause(reports.consumer_wait_point());
             }
             if (!running.load(std::memory_order_acquire)) { break; }
             wait.reset();
-            TradeMsg& t = *slot;
-
-            TradeWire wire{
-                htonl(t.bid_order_id),
-                htonl(t.ask_order_id),
-                htonl(t.price_tick),
-                htonl(t.qty)
-            };
+            perf.begin();
 
-            (void)sendto(fd, &wire, sizeof(wire), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            uint32_t n = 0;
+            do {
+                batch[n++] = to_wire(*slot);
+                reports.release_consumer_slot();
+            } while (n < REPORTS_PER_DATAGRAM && reports.try_acquire_consumer_slot(slot));
 
-            trades.release_consumer_slot();
+            ssize_t sent = sendto(fd, batch, n * sizeof(ReportWire), 0,
+                                  reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            metrics.reports.add(n);
+            if (sent < 0) {
+                metrics.send_errors.add();
+            } else {
+                metrics.datagrams.add();
+            }
+            perf.end(n);
         }
         close(fd);
     });
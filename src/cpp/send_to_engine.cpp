@@ -12,18 +12,36 @@
 #include <poll.h>
 #include <iostream>
 #include <cstdint>
+#include <cstring>
 #include <arpa/inet.h>
 #include <unordered_map>
 #include <vector>
 #include <mutex>
 #include <filesystem>
 #include <fstream>
+#include <atomic>
+#include <immintrin.h>
 #include "../cpp_helpers/protocols.hpp"
+#include "hdr_hist.h"
+
+// usage: ./send_to_engine                        2000 random limits in bursts, trade latencies
+//                                                appended to LATENCY_FILE
+//        ./send_to_engine --rate N [--poisson] [--secs S]
+//                                                open loop, see open_loop() below
+//        --session N                             v2 header session, 1..4095 (default from the pid)
 
 static constexpr const char* DST_IP = "192.168.37.128";
 static constexpr uint16_t DST_PORT = 9000;
 static constexpr uint16_t TRADE_LISTEN_PORT = 9001;
 static constexpr const char* LATENCY_FILE = "data/latencies.csv";
+static constexpr uint8_t WIRE_VERSION = 2;         // 1: one Packet per datagram, 2: batched
+static constexpr uint32_t MSGS_PER_DATAGRAM = 16;  // v2 only, up to WIRE_V2_MAX_MSGS
+static constexpr const char* HDR_FILE = "data/latency_hdr.txt"; // open loop, HdrHistogram format
+static constexpr uint32_t OPEN_LOOP_IDS = 100000;  // order ids cycle under the engine's MAX_ORDER_ID
+static constexpr uint32_t CANCEL_LAG = 64;         // open loop: new orders a cancel trails by
+static constexpr uint64_t DRAIN_NS = 1'000'000'000; // wait for late replies after the last send
+static constexpr uint32_t SESSION_SPACE = 4096;    // UDP_SESSIONS in book_types.h, header sessions below it
+static_assert(MSGS_PER_DATAGRAM >= 1 && MSGS_PER_DATAGRAM <= WIRE_V2_MAX_MSGS);
 
 namespace {
 uint64_t now_ns() {
@@ -32,6 +50,12 @@ uint64_t now_ns() {
 }
 }
 
+// v2 BatchHeader session. By default from the pid so every run is a new session to
+// the engine: seqs restart at 1 each run, and under a reused session they'd be dropped
+// as dupes. Kept inside [1, SESSION_SPACE) like the engine's UDP ids; two senders
+// whose pids land on the same value share a session, so pass --session to pick one.
+static uint16_t g_session = 0;
+
 static std::unordered_map<uint32_t, uint64_t> g_send_ts;
 static std::vector<uint64_t> g_lat;
 static std::mutex g_mu;
@@ -58,38 +82,66 @@ static void send_loop() {
         std::cerr << "bad DST_IP\n"; std::exit(1);
     }
 
+    // v2 datagram being filled: header then up to MSGS_PER_DATAGRAM entries
+    alignas(4) uint8_t batch[sizeof(BatchHeader) + WIRE_V2_MAX_MSGS * sizeof(OrderWire)];
+    uint32_t batched = 0;
+    auto flush = [&](uint32_t next_seq) {
+        if (batched == 0) { return; }
+        const BatchHeader h{WIRE_V2, (uint8_t)batched, htons(g_session), htonl(next_seq - batched)};
+        std::memcpy(batch, &h, sizeof(h));
+        const size_t len = sizeof(BatchHeader) + batched * sizeof(OrderWire);
+        if (sendto(fd, batch, len, 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            std::perror("sendto");
+        }
+        batched = 0;
+    };
+
     uint32_t seq = 1;
     int counter = 0;
     int since_pause = 0;
     while (counter < 2000) {
         // randomish orders
-        Packet p{};
-        p.seq_num = htonl(seq);
-        p.order_id = htonl(seq);
+        OrderWire w{};
+        w.order_id = htonl(seq);
         const uint32_t px = base_price + price_delta(engine);
-        p.price_tick = htonl(px > 1 ? px : 1u);
-        p.qty = htonl((uint32_t)qty_dist(engine));
-        p.msg_type = MsgType::NewLimit;
-        p.side = side_dist(engine) ? Order_Type::Buy : Order_Type::Sell;
+        w.price_tick = htonl(px > 1 ? px : 1u);
+        w.qty = htonl((uint32_t)qty_dist(engine));
+        w.msg_type = MsgType::NewLimit;
+        w.side = side_dist(engine) ? Order_Type::Buy : Order_Type::Sell;
 
         {
             std::lock_guard<std::mutex> lg(g_mu);
             g_send_ts[seq] = now_ns();
         }
 
-        if (sendto(fd, &p, sizeof(p), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
-            std::perror("sendto");
+        if (WIRE_VERSION == 1) {
+            Packet p{};
+            p.seq_num = htonl(seq);
+            p.order_id = w.order_id;
+            p.price_tick = w.price_tick;
+            p.qty = w.qty;
+            p.msg_type = w.msg_type;
+            p.side = w.side;
+            if (sendto(fd, &p, sizeof(p), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                std::perror("sendto");
+            }
+        } 
+        else {
+            std::memcpy(batch + sizeof(BatchHeader) + batched * sizeof(OrderWire), &w, sizeof(w));
+            if (++batched == MSGS_PER_DATAGRAM) { flush(seq + 1); }
         }
 
         ++seq; ++counter;
         ++since_pause;
         if (since_pause >= pause_after) { // randomized pauses so everything isnt sent at once
+            flush(seq);
             std::this_thread::sleep_for(std::chrono::microseconds(100));
             since_pause = 0;
             pause_after = pause_mult(engine) * 200;
         }
     //    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms(engine)));
     }
+    flush(seq);
 }
 
 static void recv_trades_loop() {
@@ -146,21 +198,20 @@ static void recv_trades_loop() {
         }
         if ((pfd.revents & POLLIN) == 0) { continue; }
 
-        uint8_t buf[64]{};
+        uint8_t buf[2048]{};
         ssize_t n = recv(fd, buf, sizeof(buf), 0);
-        if (n < (ssize_t)sizeof(uint32_t) * 4) { continue; }
-        const uint32_t* w = reinterpret_cast<const uint32_t*>(buf);
-        uint32_t bid = ntohl(w[0]);
-        uint32_t ask = ntohl(w[1]);
-       // uint32_t px  = ntohl(w[2]);
-     //   uint32_t qty = ntohl(w[3]);
-       // total_notional += static_cast<uint64_t>(px) * qty;
-        // std::cout << "TRADE bid=" << bid << " ask=" << ask << " px=" << px << " qty=" << qty << "\n";
-        // std::cout << "TOTAL_NOTIONAL=" << total_notional << "\n";
-
-        uint64_t sent_ns = 0;
+        if (n < (ssize_t)sizeof(ReportWire)) { continue; }
+
+        // a datagram carries several reports, only trades are timed here
         bool should_flush = false;
-        {
+        for (size_t off = 0; off + sizeof(ReportWire) <= (size_t)n; off += sizeof(ReportWire)) {
+            ReportWire r;
+            std::memcpy(&r, buf + off, sizeof(r));
+            if (r.type != ExecType::Trade) { continue; }
+            uint32_t bid = ntohl(r.order_id);
+            uint32_t ask = ntohl(r.other_id);
+
+            uint64_t sent_ns = 0;
             std::lock_guard<std::mutex> lg(g_mu);
             auto itb = g_send_ts.find(bid);
             auto ita = g_send_ts.find(ask);
@@ -191,7 +242,209 @@ static void recv_trades_loop() {
     }
 }
 
-int main() {
+// Open loop: message i is due at start + at[i], a fixed 1/rate apart or Poisson
+// (exponential gaps), and goes out then whether or not earlier ones were answered.
+// A sender that falls behind sends everything overdue at once, batched, and never
+// skips. Latency runs from the intended time to the first reply (ack or reject),
+// so every message counts, traded or not, and a stall shows up in the latencies
+// of everything scheduled during it instead of being omitted.
+//
+// The wire has no room for a timestamp, so the intended time isn't sent: the engine
+// already echoes the seq in acks and the order ids in trades, and the whole schedule
+// is built up front, so the receive thread looks both up without locks. Even messages
+// are new limits around 10000, odd ones cancel the new order CANCEL_LAG back so the
+// book stays shallow (a cancel of an order that already traded is rejected, which is
+// a reply like any other). Trade latency is timed to the first trade of the taker.
+struct OpenLoop {
+    uint64_t rate;
+    bool poisson;
+    uint32_t secs;
+};
+
+static int open_loop(const OpenLoop& cfg) {
+    const uint64_t n = cfg.rate * cfg.secs;
+    if (n == 0 || n >= UINT32_MAX) {
+        std::fprintf(stderr, "rate * secs must be 1..%u messages\n", UINT32_MAX - 1);
+        return 1;
+    }
+    std::vector<uint64_t> at(n);                 // intended send, ns from start
+    std::vector<OrderWire> msgs(n);
+    std::vector<std::atomic<uint32_t>> id_seq(OPEN_LOOP_IDS + 1); // seq of the latest new order per id
+    std::mt19937_64 rng(std::time(nullptr));
+    std::exponential_distribution<double> gap(1.0);
+    std::uniform_int_distribution<int> price_delta(-10, 10);
+    std::uniform_int_distribution<uint32_t> qty_dist(1, 100);
+    const double interval_ns = 1e9 / (double)cfg.rate;
+    double t = 0;
+    for (uint64_t i{}; i < n; i++) {
+        at[i] = (uint64_t)t;
+        t += cfg.poisson ? gap(rng) * interval_ns : interval_ns;
+        OrderWire& w = msgs[i];
+        const bool cancel = (i % 2 == 1);
+        // the new order a cancel pulls, the one just before it until there are enough
+        const uint64_t target = !cancel ? i : (i > 2 * CANCEL_LAG) ? i - 1 - 2 * CANCEL_LAG : i - 1;
+        w.order_id = htonl((uint32_t)(target / 2 % OPEN_LOOP_IDS) + 1);
+        w.price_tick = htonl((uint32_t)(10000 + price_delta(rng)));
+        w.qty = htonl(qty_dist(rng));
+        w.msg_type = cancel ? MsgType::Cancel : MsgType::NewLimit;
+        w.side = cancel ? msgs[target].side : (rng() & 1) ? Order_Type::Buy : Order_Type::Sell;
+    }
+
+    // first reply and first trade per message, written by the receive thread only
+    std::vector<uint64_t> sent(n), replied(n), traded(n);
+    std::atomic<bool> sending{true};
+    uint64_t start = 0;
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in rx_addr{};
+    rx_addr.sin_family = AF_INET;
+    rx_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    rx_addr.sin_port = htons(TRADE_LISTEN_PORT);
+    if (rx < 0 || bind(rx, reinterpret_cast<sockaddr*>(&rx_addr), sizeof(rx_addr)) < 0) {
+        std::perror("bind trade recv");
+        return 1;
+    }
+    std::thread receiver([&] {
+        uint8_t buf[2048];
+        uint64_t idle_since = 0;
+        for (;;) {
+            const ssize_t len = recv(rx, buf, sizeof(buf), MSG_DONTWAIT);
+            const uint64_t now = now_ns();
+            if (len < (ssize_t)sizeof(ReportWire)) {
+                if (sending.load(std::memory_order_acquire)) { idle_since = 0; }
+                else if (idle_since == 0) { idle_since = now; }
+                else if (now - idle_since > DRAIN_NS) { return; }
+                _mm_pause();
+                continue;
+            }
+            idle_since = 0;
+            for (size_t off = 0; off + sizeof(ReportWire) <= (size_t)len; off += sizeof(ReportWire)) {
+                ReportWire r;
+                std::memcpy(&r, buf + off, sizeof(r));
+                if (r.type != ExecType::Trade) {
+                    const uint32_t seq = ntohl(r.client_seq);
+                    if (seq >= 1 && seq <= n && replied[seq - 1] == 0) { replied[seq - 1] = now; }
+                    continue;
+                }
+                const uint32_t bid = ntohl(r.order_id);
+                const uint32_t ask = ntohl(r.other_id);
+                if (bid > OPEN_LOOP_IDS || ask > OPEN_LOOP_IDS) { continue; }
+                const uint32_t a = id_seq[bid].load(std::memory_order_relaxed);
+                const uint32_t b = id_seq[ask].load(std::memory_order_relaxed);
+                const uint32_t taker = (a > b) ? a : b; // the later one crossed
+                if (taker != 0 && traded[taker - 1] == 0) { traded[taker - 1] = now; }
+            }
+        }
+    });
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DST_PORT);
+    if (fd < 0 || inet_pton(AF_INET, DST_IP, &addr.sin_addr) != 1) {
+        std::perror("socket");
+        return 1;
+    }
+    alignas(4) uint8_t batch[sizeof(BatchHeader) + WIRE_V2_MAX_MSGS * sizeof(OrderWire)];
+    start = now_ns() + 1'000'000; // a moment for the receiver to start
+    uint64_t late = 0;            // messages sent more than 10us after their slot
+    for (uint64_t i = 0; i < n;) {
+        const uint64_t due = start + at[i];
+        uint64_t now = now_ns();
+        if (now < due) {
+            if (due - now > 200'000) { std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 100'000)); }
+            else { _mm_pause(); }
+            continue;
+        }
+        // everything due by now goes out, up to a datagram's worth at a time
+        uint64_t k = 0;
+        const uint32_t most = (WIRE_VERSION == 1) ? 1 : MSGS_PER_DATAGRAM;
+        while (i + k < n && k < most && start + at[i + k] <= now) {
+            const uint64_t j = i + k;
+            if (msgs[j].msg_type == MsgType::NewLimit) { // before its trade can come back
+                id_seq[ntohl(msgs[j].order_id)].store((uint32_t)(j + 1), std::memory_order_relaxed);
+            }
+            sent[j] = now;
+            if (now - (start + at[j]) > 10'000) { ++late; }
+            std::memcpy(batch + sizeof(BatchHeader) + k * sizeof(OrderWire), &msgs[j], sizeof(OrderWire));
+            ++k;
+        }
+        ssize_t rc;
+        if (WIRE_VERSION == 1) {
+            const OrderWire& w = msgs[i];
+            const Packet p{htonl((uint32_t)i + 1), w.order_id, w.price_tick, w.qty, w.msg_type, w.side, 0};
+            rc = sendto(fd, &p, sizeof(p), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        }
+        else {
+            const BatchHeader h{WIRE_V2, (uint8_t)k, htons(g_session), htonl((uint32_t)i + 1)};
+            std::memcpy(batch, &h, sizeof(h));
+            rc = sendto(fd, batch, sizeof(BatchHeader) + k * sizeof(OrderWire), 0,
+                        reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        }
+        if (rc < 0) { std::perror("sendto"); }
+        i += k;
+    }
+    sending.store(false, std::memory_order_release);
+    receiver.join();
+    close(fd);
+    close(rx);
+
+    HdrHist<> from_intended, from_sent, corrected, to_trade;
+    uint64_t unanswered = 0;
+    for (uint64_t i{}; i < n; i++) {
+        if (traded[i] != 0) { to_trade.record(traded[i] - (start + at[i])); }
+        if (replied[i] == 0) {
+            ++unanswered;
+            continue;
+        }
+        from_intended.record(replied[i] - (start + at[i]));
+        from_sent.record(replied[i] - sent[i]);
+        corrected.record_corrected(replied[i] - sent[i], (uint64_t)interval_ns);
+    }
+    std::printf("%lu msgs at %lu/s %s over %us, %lu sent late (>10us), %lu unanswered\n",
+                (unsigned long)n, (unsigned long)cfg.rate, cfg.poisson ? "poisson" : "fixed", cfg.secs,
+                (unsigned long)late, (unsigned long)unanswered);
+    auto line = [](const char* name, const HdrHist<>& h) {
+        std::printf("  %-22s n %9lu  p50 %8.1f  p99 %8.1f  p99.9 %8.1f  p99.99 %8.1f  max %8.1f us\n", name,
+                    (unsigned long)h.count(), h.value_at(50) / 1e3, h.value_at(99) / 1e3,
+                    h.value_at(99.9) / 1e3, h.value_at(99.99) / 1e3, h.max() / 1e3);
+    };
+    line("intended -> reply", from_intended);
+    line("sent -> reply (raw)", from_sent);
+    line("sent -> reply (co fix)", corrected);
+    line("intended -> trade", to_trade);
+
+    std::filesystem::create_directories("data");
+    if (FILE* f = std::fopen(HDR_FILE, "w")) {
+        from_intended.print_distribution(f, 1e3); // microseconds
+        std::fclose(f);
+        std::printf("intended -> reply distribution in %s\n", HDR_FILE);
+    }
+    return unanswered == n ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    OpenLoop cfg{0, false, 10};
+    for (int i = 1; i < argc; i++) {
+        const bool has_val = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--rate") && has_val) { cfg.rate = std::strtoull(argv[++i], nullptr, 10); }
+        else if (!std::strcmp(argv[i], "--secs") && has_val) { cfg.secs = (uint32_t)std::atoi(argv[++i]); }
+        else if (!std::strcmp(argv[i], "--poisson")) { cfg.poisson = true; }
+        else if (!std::strcmp(argv[i], "--session") && has_val) {
+            const unsigned long v = std::strtoul(argv[++i], nullptr, 10);
+            if (v == 0 || v >= SESSION_SPACE) {
+                std::fprintf(stderr, "--session must be 1..%u\n", SESSION_SPACE - 1);
+                return 1;
+            }
+            g_session = (uint16_t)v;
+        }
+        else {
+            std::fprintf(stderr, "usage: %s [--rate N [--poisson] [--secs S]] [--session N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (g_session == 0) { g_session = (uint16_t)(1 + (uint32_t)getpid() % (SESSION_SPACE - 1)); }
+    if (cfg.rate != 0) { return open_loop(cfg); }
     std::thread t(send_loop);
     recv_trades_loop();
     t.join();
@@ -4,20 +4,59 @@
 #include <atomic>
 #include <cstdint>
 #include <chrono>
+#include <climits>
 #include <thread>
+#include <cpuid.h>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "metrics.h"
 
+// What a waiter is blocked on: `word` moving away from `seen`. `sleepers` is
+// bumped by blocking strategies so the other side knows to issue a wake.
+struct WaitPoint {
+    const std::atomic<uint32_t>& word;
+    uint32_t seen;
+    std::atomic<uint32_t>& sleepers;
+};
+
+static inline void futex_wake_all(const std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+
+static inline bool cpu_has_waitpkg() {
+    unsigned a, b, c, d;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) { return false; }
+    return (c >> 5) & 1; // CPUID.7.0:ECX[5] = WAITPKG
+}
+
+inline const bool kCpuHasWaitpkg = cpu_has_waitpkg();
+
+// Wait strategies. Every strategy has pause(const WaitPoint&) and reset(), so ring
+// consumers/producers take one as a template parameter and each thread picks its own.
+// Setting `stats` makes a strategy tally its waits into the owning thread's metrics.
+
+// Hybrid backoff: pause-spin, then yield, then short sleeps. Cheap on shared cores
+// but the sleep phase can cost tens of us to wake on a loaded host.
 struct SpinWait {
     uint32_t count = 0;
+    WaitCounters* stats = nullptr;
 
-    inline void pause() {
+    inline void pause(const WaitPoint&) {
         if (count < 64) {
-            std::atomic_signal_fence(std::memory_order_relaxed);
+            _mm_pause();
+            if (stats) { stats->spins.add(); }
         } 
         else if (count < 128) {
             std::this_thread::yield();
+            if (stats) { stats->yields.add(); }
         } 
         else {
             std::this_thread::sleep_for(std::chrono::microseconds(1));
+            if (stats) { stats->sleeps.add(); }
         }
         ++count;
     }
@@ -25,6 +64,71 @@ struct SpinWait {
     inline void reset() { count = 0; }
 };
 
+// Pure spin with the pause hint. Lowest wake latency, burns the whole core.
+struct BusySpinWait {
+    WaitCounters* stats = nullptr;
+
+    inline void pause(const WaitPoint&) {
+        _mm_pause();
+        if (stats) { stats->spins.add(); }
+    }
+    inline void reset() {}
+};
+
+// umonitor/umwait on the ring index: the core drops into C0.1 until the other side
+// writes the line or the TSC deadline passes. Falls back to pause without WAITPKG.
+struct UmwaitWait {
+    static constexpr uint64_t kDeadlineCycles = 20000; // ~5-10us, bounds a missed store
+    WaitCounters* stats = nullptr;
+
+    __attribute__((target("waitpkg")))
+    inline void pause(const WaitPoint& wp) {
+        if (!kCpuHasWaitpkg) {
+            _mm_pause();
+            if (stats) { stats->spins.add(); }
+            return;
+        }
+        _umonitor(const_cast<std::atomic<uint32_t>*>(&wp.word));
+        if (wp.word.load(std::memory_order_acquire) != wp.seen) { return; }
+        _umwait(1, __rdtsc() + kDeadlineCycles); // 1 => C0.1, faster wake than C0.2
+        if (stats) { stats->sleeps.add(); }
+    }
+
+    inline void reset() {}
+};
+
+// Spin briefly, then sleep in the kernel on the ring index with futex. Idle threads
+// cost nothing; the other side only pays a syscall when `sleepers` is non-zero. The
+// bump of `sleepers` and the reload of the index are fenced here, and the index
+// store and the `sleepers` load are fenced in the ring, so one side always sees the
+// other. The wait is still timed, as a backstop.
+struct FutexWait {
+    static constexpr uint32_t kSpins = 256;
+    static constexpr long kTimeoutNs = 200'000;
+    uint32_t count = 0;
+    WaitCounters* stats = nullptr;
+
+    inline void pause(const WaitPoint& wp) {
+        if (count < kSpins) {
+            ++count;
+            _mm_pause();
+            if (stats) { stats->spins.add(); }
+            return;
+        }
+        if (stats) { stats->sleeps.add(); }
+        wp.sleepers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with wake_sleepers
+        if (wp.word.load(std::memory_order_seq_cst) == wp.seen) {
+            timespec ts{0, kTimeoutNs};
+            syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&wp.word), FUTEX_WAIT_PRIVATE,
+                    wp.seen, &ts, nullptr, 0);
+        }
+        wp.sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    inline void reset() { count = 0; }
+};
+
 template <typename T, uint32_t N>
 class SpscRing {
     static_assert((N & (N - 1)) == 0, "N must be power of two");
@@ -35,6 +139,15 @@ class SpscRing {
     alignas(64) std::atomic<uint32_t> write_ptr{0};
     alignas(64) uint32_t cached_write_ptr{0};
     alignas(64) uint32_t cached_read_ptr{0};
+    alignas(64) std::atomic<uint32_t> sleepers_{0}; // blocked waiters, rarely written
+
+    // After publishing an index. Store then load of a different word: without the
+    // fence the load can pass the store, and against FutexWait's bump-then-reload
+    // both sides can miss each other and the waiter sleeps out its timeout.
+    inline void wake_sleepers(const std::atomic<uint32_t>& word) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) != 0) { futex_wake_all(word); }
+    }
 
     public:
 
@@ -54,6 +167,38 @@ class SpscRing {
     inline void commit_producer_slot() {
         const uint32_t head = read_ptr.load(std::memory_order_relaxed);
         read_ptr.store(head + 1, std::memory_order_release);
+        wake_sleepers(read_ptr);
+    }
+
+    // batch form: reserve up to want slots, fill producer_slot(0..n-1), commit n
+    inline uint32_t try_acquire_producer_slots(uint32_t want) {
+        const uint32_t head = read_ptr.load(std::memory_order_relaxed);
+        uint32_t free = N - (head - cached_write_ptr);
+        if (free < want) {
+            cached_write_ptr = write_ptr.load(std::memory_order_acquire);
+            free = N - (head - cached_write_ptr);
+        }
+        return (free < want) ? free : want;
+    }
+
+    // index of the next slot the producer will fill, and of the slot the consumer
+    // holds; each side reads only its own
+    inline uint32_t producer_pos() const { return read_ptr.load(std::memory_order_relaxed); }
+    inline uint32_t consumer_pos() const { return write_ptr.load(std::memory_order_relaxed); }
+
+    // occupancy as the producer last saw it, no load of the consumer's line
+    inline uint32_t producer_depth() const {
+        return read_ptr.load(std::memory_order_relaxed) - cached_write_ptr;
+    }
+
+    inline T* producer_slot(uint32_t i) {
+        return &buf_[(read_ptr.load(std::memory_order_relaxed) + i) & (N - 1)];
+    }
+
+    inline void commit_producer_slots(uint32_t n) {
+        const uint32_t head = read_ptr.load(std::memory_order_relaxed);
+        read_ptr.store(head + n, std::memory_order_release);
+        wake_sleepers(read_ptr);
     }
 
     inline bool try_acquire_consumer_slot(T*& slot) {
@@ -71,5 +216,16 @@ class SpscRing {
     inline void release_consumer_slot() {
         const uint32_t tail = write_ptr.load(std::memory_order_relaxed);
         write_ptr.store(tail + 1, std::memory_order_release);
+        wake_sleepers(write_ptr);
+    }
+
+    // consumer waits for the producer index to move past the current tail
+    inline WaitPoint consumer_wait_point() {
+        return WaitPoint{read_ptr, write_ptr.load(std::memory_order_relaxed), sleepers_};
+    }
+
+    // producer waits for the consumer index to free the slot it needs
+    inline WaitPoint producer_wait_point() {
+        return WaitPoint{write_ptr, read_ptr.load(std::memory_order_relaxed) - N, sleepers_};
     }
 };
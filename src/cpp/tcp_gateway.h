@@ -0,0 +1,429 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "match.h"
+#include "recv_helper.h"
+#include "send_from_engine.h"
+
+// TCP order entry for clients that can't do raw UDP (see GwHeader in protocols.hpp).
+// One thread runs every connection off a level-triggered epoll: each round reads
+// once from every ready socket into that connection's buffer, cuts out the complete
+// frames, and lists the orders as RxMsgs pointing into those buffers, the same
+// form gather_payloads produces for XDP frames. The round's orders are then
+// byte-swapped straight into the gateway's own order ring with decode_payloads
+// and committed together. The matcher drains it alongside the XDP ring.
+//
+// A login names a session key. The first login with a key gets one of the session
+// ids above UDP_SESSIONS, and the seq space belongs to the key, not the
+// connection, so a reconnect resumes at LoginAck's next_seq and anything resent
+// below it is dropped as a dupe. A key is live on one connection at a time. The
+// first login with a key also queues a Control::Bind for the matcher ahead of its
+// orders, so the key lands in the replica journal and a standby taking over can
+// resume() every session with its id and next seq.
+// When the ring is full the gateway stops reading, and TCP pushes back on the
+// clients.
+//
+// Every report still goes out on the UDP report stream. The matcher also copies a
+// gateway session's acks, rejects and fills onto a report ring of its own, and each
+// round the gateway drains it into the logged-in connection's out buffer as Report
+// frames and sends what the socket takes. A session with no connection right now
+// misses those (they are not replayed on reconnect), and a client that lets its
+// out buffer fill is closed. The epoll timeout drops to 0 for GW_HOT_NS after any
+// traffic, so an ack goes back within a round; a fill on a quiet gateway can wait
+// up to GW_IDLE_MS.
+
+static constexpr uint32_t GW_READ_BUF = 16384;   // per connection, one read is up to ~630 orders
+static constexpr uint32_t GW_EVENTS = 1024;      // ready sockets per epoll_wait
+static constexpr uint32_t GW_BATCH = 8192;       // orders per ring commit, at most
+static constexpr uint32_t GW_MAX_BODY = 64;      // anything longer is a bad frame
+static constexpr uint32_t GW_OUT_BUF = 16384;    // per connection, ~500 reports the client hasn't read
+static constexpr int GW_IDLE_MS = 1;             // epoll timeout, how often an idle gateway checks running
+static constexpr uint64_t GW_HOT_NS = 1000000;   // poll without blocking this long after traffic
+static constexpr uint32_t GW_SESSIONS = LOCAL_SESSION_BASE - UDP_SESSIONS;
+static constexpr uint32_t GW_ORDER_FRAME = sizeof(GwHeader) + sizeof(Packet);
+static constexpr uint32_t GW_REPORT_FRAME = sizeof(GwHeader) + sizeof(ReportWire);
+static constexpr uint32_t GW_MSGS_PER_READ = GW_READ_BUF / GW_ORDER_FRAME + 1; // + a login's Bind
+static_assert(GW_BATCH <= ORDER_RING_SIZE, "one round must fit the gateway ring");
+static_assert(GW_BATCH >= GW_MSGS_PER_READ, "one read must fit a round");
+
+template <typename Wait = SpinWait>
+class TcpGateway {
+    struct Conn {
+        int fd = -1;
+        uint16_t session = 0;    // 0 until login
+        bool touched = false;    // read this round, settle() after the commit
+        bool closing = false;    // close once the round's orders are on the ring
+        bool pending = false;    // on pending_, out has bytes to send
+        uint32_t start = 0;      // first byte not yet parsed
+        uint32_t end = 0;        // one past the last byte read
+        uint32_t out_len = 0;    // Report frames not yet taken by the socket
+        uint8_t buf[GW_READ_BUF];
+        uint8_t out[GW_OUT_BUF];
+    };
+
+    struct Session {
+        uint32_t next_seq = 1;
+        int fd = -1;             // connection logged in on it, -1 when none
+        OrderWire bind{};        // Control::Bind body, order_id = session key
+    };
+
+    OrderMsgRing& ring_;
+    GwReportRing& reports_;
+    GatewayMetrics& m_;
+    std::atomic<bool>& running_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    uint32_t open_ = 0;
+    std::vector<std::unique_ptr<Conn>> conns_;     // by fd
+    std::vector<Conn*> touched_;
+    std::vector<Conn*> pending_;
+    std::vector<Session> sessions_ = std::vector<Session>(GW_SESSIONS);
+    std::unordered_map<uint32_t, uint16_t> by_key_; // logins only, never per order
+    std::vector<RxMsg> msgs_ = std::vector<RxMsg>(GW_BATCH);
+    uint32_t n_ = 0;
+    uint64_t hot_until_ = 0;
+    Wait wait_;
+
+public:
+    TcpGateway(uint16_t port, OrderMsgRing& ring, GwReportRing& reports, GatewayMetrics& metrics,
+               std::atomic<bool>& running)
+        : ring_(ring), reports_(reports), m_(metrics), running_(running) {
+        wait_.stats = &m_.wait;
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            std::perror("gateway socket");
+            std::exit(1);
+        }
+        const int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::perror("gateway bind");
+            std::exit(1);
+        }
+        if (listen(listen_fd_, SOMAXCONN) != 0) {
+            std::perror("gateway listen");
+            std::exit(1);
+        }
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) {
+            std::perror("epoll_create1");
+            std::exit(1);
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) != 0) {
+            std::perror("epoll_ctl listen");
+            std::exit(1);
+        }
+    }
+    ~TcpGateway() {
+        for (auto& c : conns_) {
+            if (c) { close(c->fd); }
+        }
+        close(epoll_fd_);
+        close(listen_fd_);
+    }
+    TcpGateway(const TcpGateway&) = delete;
+    TcpGateway& operator=(const TcpGateway&) = delete;
+
+    // standby taking over: a session the primary's gateway had, before run()
+    inline void resume(uint32_t key, uint16_t id, uint32_t next_seq) {
+        if (id < UDP_SESSIONS || id >= LOCAL_SESSION_BASE) { return; }
+        by_key_[key] = id;
+        sessions_[id - UDP_SESSIONS].next_seq = next_seq;
+    }
+
+    void run() {
+        std::vector<epoll_event> events(GW_EVENTS);
+        while (running_.load(std::memory_order_acquire)) {
+            const int timeout = metrics_now_ns() < hot_until_ ? 0 : GW_IDLE_MS;
+            const int nev = epoll_wait(epoll_fd_, events.data(), (int)GW_EVENTS, timeout);
+            if (nev < 0) {
+                if (errno == EINTR) { continue; }
+                std::perror("epoll_wait");
+                return;
+            }
+            const uint64_t now = metrics_now_ns(); // rx_ns for every order read this round
+            for (int i{}; i < nev; i++) {
+                const int fd = events[i].data.fd;
+                if (fd == listen_fd_) {
+                    accept_all();
+                    continue;
+                }
+                Conn* c = conns_[fd].get();
+                if (!c || c->closing) { continue; }
+                // round is full; level-triggered, so the socket comes back next round
+                if (n_ + GW_MSGS_PER_READ > GW_BATCH) { continue; }
+                read_conn(*c, now);
+            }
+            if (nev > 0) { hot_until_ = now + GW_HOT_NS; }
+            commit();
+            for (Conn* c : touched_) { settle(*c); }
+            touched_.clear();
+            if (send_reports() != 0) { hot_until_ = now + GW_HOT_NS; }
+        }
+    }
+
+private:
+    void accept_all() {
+        for (;;) {
+            // out of fds (EMFILE) leaves the rest in the backlog until one closes
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) { return; }
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // acks to logins go out now
+            if ((size_t)fd >= conns_.size()) { conns_.resize(fd + 1); }
+            conns_[fd] = std::make_unique<Conn>();
+            conns_[fd]->fd = fd;
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                std::perror("epoll_ctl conn");
+                close(fd);
+                conns_[fd].reset();
+                continue;
+            }
+            m_.accepted.add();
+            m_.connections.set(++open_);
+        }
+    }
+
+    inline void touch(Conn& c) {
+        if (!c.touched) {
+            c.touched = true;
+            touched_.push_back(&c);
+        }
+    }
+
+    void read_conn(Conn& c, uint64_t now) {
+        const ssize_t r = read(c.fd, c.buf + c.end, GW_READ_BUF - c.end);
+        if (r < 0 && (errno == EAGAIN || errno == EINTR)) { return; }
+        touch(c);
+        if (r <= 0) { // peer closed or reset
+            c.closing = true;
+            return;
+        }
+        m_.reads.add();
+        c.end += (uint32_t)r;
+        parse(c, now);
+    }
+
+    // every complete frame in the buffer; a partial one waits for the next read
+    void parse(Conn& c, uint64_t now) {
+        constexpr uint8_t stop_off = offsetof(Packet, stop_tick) - kV1BodyOff;
+        while (c.end - c.start >= sizeof(GwHeader)) {
+            GwHeader h;
+            std::memcpy(&h, c.buf + c.start, sizeof(h));
+            const uint32_t len = ntohs(h.len);
+            if (len > GW_MAX_BODY) { return bad_frame(c); }
+            if (c.end - c.start < sizeof(GwHeader) + len) { return; }
+            const uint8_t* body = c.buf + c.start + sizeof(GwHeader);
+            c.start += sizeof(GwHeader) + len;
+
+            if (h.type == GwType::Order && len == sizeof(Packet) && c.session != 0) {
+                uint32_t seq;
+                std::memcpy(&seq, body, sizeof(seq));
+                seq = ntohl(seq);
+                Session& s = sessions_[c.session - UDP_SESSIONS];
+                if (seq < s.next_seq) {
+                    m_.dupes.add();
+                    continue;
+                }
+                if (seq != s.next_seq) { m_.seq_gaps.add(seq - s.next_seq); }
+                s.next_seq = seq + 1;
+                msgs_[n_++] = RxMsg{body + kV1BodyOff, seq, c.session, stop_off, 0, now};
+            }
+            else if (h.type == GwType::Login && len == sizeof(GwLogin) && c.session == 0) {
+                if (!login(c, body)) { return; }
+            }
+            else {
+                return bad_frame(c);
+            }
+        }
+    }
+
+    bool login(Conn& c, const uint8_t* body) {
+        GwLogin req;
+        std::memcpy(&req, body, sizeof(req));
+        const uint32_t key = ntohl(req.session_key);
+        uint16_t id;
+        const auto it = by_key_.find(key);
+        if (it != by_key_.end()) {
+            id = it->second;
+            if (sessions_[id - UDP_SESSIONS].fd >= 0) { return reject(c, GwRejectReason::InUse); }
+        }
+        else {
+            if (by_key_.size() >= GW_SESSIONS) { return reject(c, GwRejectReason::Full); }
+            id = (uint16_t)(UDP_SESSIONS + by_key_.size());
+            by_key_.emplace(key, id);
+            OrderWire& b = sessions_[id - UDP_SESSIONS].bind;
+            b.order_id = htonl(key);
+            b.qty = htonl(id);
+            b.msg_type = static_cast<MsgType>(Control::Bind);
+            msgs_[n_++] = RxMsg{reinterpret_cast<const uint8_t*>(&b), 0, CONTROL_SESSION,
+                                (uint8_t)offsetof(OrderWire, stop_tick), 0, 0};
+        }
+        Session& s = sessions_[id - UDP_SESSIONS];
+        s.fd = c.fd;
+        c.session = id;
+        m_.logins.add();
+        const GwLoginAck ack{htons(id), 0, htonl(s.next_seq)};
+        if (!send_frame(c, GwType::LoginAck, &ack, sizeof(ack))) {
+            c.closing = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool reject(Conn& c, GwRejectReason why) {
+        m_.login_rejects.add();
+        send_frame(c, GwType::LoginReject, &why, sizeof(why));
+        c.closing = true;
+        return false;
+    }
+
+    void bad_frame(Conn& c) {
+        m_.bad_frames.add();
+        c.closing = true;
+    }
+
+    // replies are a few bytes into an empty send buffer; one that doesn't fit means
+    // the client isn't reading and gets dropped
+    static bool send_frame(const Conn& c, GwType type, const void* body, uint16_t len) {
+        uint8_t frame[sizeof(GwHeader) + GW_MAX_BODY];
+        const GwHeader h{htons(len), type, 0};
+        std::memcpy(frame, &h, sizeof(h));
+        std::memcpy(frame + sizeof(h), body, len);
+        const ssize_t sent = send(c.fd, frame, sizeof(h) + len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        return sent == (ssize_t)(sizeof(h) + len);
+    }
+
+    // the matcher's copies for gateway sessions, framed onto their connections; returns
+    // how many were drained. Runs after settle(), so a connection closed here goes now.
+    uint32_t send_reports() {
+        GwReport* g;
+        uint32_t k = 0;
+        while (k < GW_REPORT_RING_SIZE && reports_.try_acquire_consumer_slot(g)) {
+            const int fd = sessions_[g->session - UDP_SESSIONS].fd;
+            Conn* c = fd >= 0 ? conns_[fd].get() : nullptr;
+            if (c && !c->closing) {
+                queue_report(*c, g->report);
+            }
+            else {
+                m_.reports_unrouted.add();
+            }
+            reports_.release_consumer_slot();
+            ++k;
+        }
+        for (size_t i{}; i < pending_.size();) {
+            Conn& c = *pending_[i];
+            if (!c.closing) { flush(c); }
+            if (c.closing || c.out_len == 0) {
+                c.pending = false;
+                pending_[i] = pending_.back();
+                pending_.pop_back();
+                if (c.closing) { settle(c); }
+                continue;
+            }
+            ++i;
+        }
+        return k;
+    }
+
+    void queue_report(Conn& c, const ExecReport& r) {
+        if (c.out_len + GW_REPORT_FRAME > GW_OUT_BUF) { flush(c); }
+        if (c.out_len + GW_REPORT_FRAME > GW_OUT_BUF || c.closing) { // client isn't reading
+            m_.report_overflows.add();
+            c.closing = true;
+            return;
+        }
+        const GwHeader h{htons(sizeof(ReportWire)), GwType::Report, 0};
+        const ReportWire w = to_wire(r);
+        std::memcpy(c.out + c.out_len, &h, sizeof(h));
+        std::memcpy(c.out + c.out_len + sizeof(h), &w, sizeof(w));
+        c.out_len += GW_REPORT_FRAME;
+        m_.reports.add();
+        if (!c.pending) {
+            c.pending = true;
+            pending_.push_back(&c);
+        }
+    }
+
+    // whatever the socket takes; a partial frame stays at the front for next round
+    void flush(Conn& c) {
+        const ssize_t sent = send(c.fd, c.out, c.out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EINTR) { c.closing = true; }
+            return;
+        }
+        const uint32_t left = c.out_len - (uint32_t)sent;
+        if (left != 0 && sent != 0) { std::memmove(c.out, c.out + sent, left); }
+        c.out_len = left;
+    }
+
+    // all of the round's orders onto the ring at once, waiting for space if the matcher is behind
+    void commit() {
+        if (n_ == 0) { return; }
+        if (ring_.try_acquire_producer_slots(n_) < n_) {
+            m_.ring_full.add();
+            while (ring_.try_acquire_producer_slots(n_) < n_) {
+                if (!running_.load(std::memory_order_acquire)) {
+                    n_ = 0;
+                    return;
+                }
+                wait_.pause(ring_.producer_wait_point());
+            }
+            wait_.reset();
+        }
+        decode_payloads(msgs_.data(), n_, ring_);
+        ring_.commit_producer_slots(n_);
+        m_.orders.add(n_);
+        n_ = 0;
+    }
+
+    // after the commit nothing points into the buffer, so the tail can move down
+    void settle(Conn& c) {
+        c.touched = false;
+        if (c.closing) {
+            if (c.session != 0) { sessions_[c.session - UDP_SESSIONS].fd = -1; }
+            if (c.pending) { // closed by a read, with reports still queued
+                for (Conn*& p : pending_) {
+                    if (p == &c) {
+                        p = pending_.back();
+                        pending_.pop_back();
+                        break;
+                    }
+                }
+            }
+            const int fd = c.fd;
+            close(fd); // also drops it from the epoll set
+            conns_[fd].reset();
+            m_.connections.set(--open_);
+            return;
+        }
+        const uint32_t left = c.end - c.start;
+        if (left != 0 && c.start != 0) { std::memmove(c.buf, c.buf + c.start, left); }
+        c.start = 0;
+        c.end = left;
+    }
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "../cpp_helpers/protocols.hpp"
+
+// A resting stop: limit_tick == 0 means stop-market
+struct StopOrder {
+    uint32_t order_id;
+    uint32_t qty;
+    uint32_t limit_tick;
+    uint16_t session;
+    Order_Type side;
+};
+
+// Pending stops for one side, indexed by trigger price with the same level bitmap
+// as VectorOrderBook. Buy stops elect when the last trade is at or above their
+// trigger, so the next one to fire is the lowest set bit (ctz); sell stops are
+// the mirror (clz). Levels keep arrival order, a cancel zeroes the entry's qty and
+// a level is compacted once most of it is dead, like the order book's tombstones.
+template <Order_Type Side, uint32_t MinPrice, uint32_t MaxPrice, uint32_t MaxOrderId>
+class TriggerBook {
+    static_assert(MinPrice <= MaxPrice, "invalid price range");
+    static constexpr uint32_t kRange = MaxPrice - MinPrice + 1;
+    static constexpr uint32_t kWordBits = 64;
+    static constexpr uint32_t kNumWords = (kRange + kWordBits - 1) / kWordBits;
+    static constexpr uint32_t kCompactMin = 16; // dead entries before a level compacts on cancel
+
+    struct Level {
+        std::vector<StopOrder> stops;
+        uint32_t live{0};
+    };
+    struct IndexSlot {
+        uint32_t trigger_tick{0};
+        uint32_t pos_in_level{0};
+        bool used{false};
+    };
+
+    std::vector<Level> levels_{kRange};
+    std::vector<IndexSlot> index_{MaxOrderId + 1};
+    std::array<uint64_t, kNumWords> level_bits_{};
+    bool has_next_{false};
+    uint32_t next_trigger_{0}; // first trigger to fire
+
+    inline uint32_t idx(uint32_t price) const { return price - MinPrice; }
+
+    inline bool in_range(uint32_t price) const {
+        return price >= MinPrice && price <= MaxPrice;
+    }
+
+    // next set level from start (inclusive) in firing order
+    inline bool scan_from(uint32_t start, uint32_t& out_price) const {
+        if constexpr (Side == Order_Type::Buy) {
+            uint32_t s_idx = idx(start < MinPrice ? MinPrice : start);
+            uint32_t word = s_idx / kWordBits;
+            uint64_t w = level_bits_[word] & (~0ULL << (s_idx % kWordBits));
+            for (;;) {
+                if (w != 0) {
+                    out_price = MinPrice + word * kWordBits + (uint32_t)__builtin_ctzll(w);
+                    return true;
+                }
+                if (++word >= kNumWords) { return false; }
+                w = level_bits_[word];
+            }
+        }
+        else {
+            uint32_t s_idx = idx(start > MaxPrice ? MaxPrice : start);
+            int32_t word = (int32_t)(s_idx / kWordBits);
+            uint32_t bit = s_idx % kWordBits;
+            uint64_t w = level_bits_[(size_t)word] & ((bit == 63) ? ~0ULL : ((1ULL << (bit + 1)) - 1));
+            for (;;) {
+                if (w != 0) {
+                    out_price = MinPrice + (uint32_t)word * kWordBits + 63 - (uint32_t)__builtin_clzll(w);
+                    return true;
+                }
+                if (--word < 0) { return false; }
+                w = level_bits_[(size_t)word];
+            }
+        }
+    }
+
+    inline void clear_level(uint32_t price) {
+        const uint32_t i = idx(price);
+        levels_[i].stops.clear();
+        levels_[i].live = 0;
+        level_bits_[i / kWordBits] &= ~(1ULL << (i % kWordBits));
+        if (has_next_ && price == next_trigger_) {
+            has_next_ = scan_from(price, next_trigger_);
+        }
+    }
+
+    // drop every cancelled entry of a level, keeping arrival order and fixing the index
+    inline void compact_level(uint32_t i) {
+        auto& stops = levels_[i].stops;
+        uint32_t w = 0;
+        for (uint32_t r{}; r < stops.size(); r++) {
+            if (stops[r].qty == 0) { continue; }
+            if (w != r) {
+                stops[w] = stops[r];
+                index_[stops[w].order_id].pos_in_level = w;
+            }
+            ++w;
+        }
+        stops.resize(w);
+    }
+
+    // a level that never fully drains would otherwise grow with every place/cancel
+    inline void maybe_compact(uint32_t i) {
+        const Level& level = levels_[i];
+        const uint32_t dead = (uint32_t)level.stops.size() - level.live;
+        if (dead >= kCompactMin && dead > level.live) { compact_level(i); }
+    }
+
+public:
+    // crossed by a trade at last_tick
+    static inline bool fires(uint32_t trigger_tick, uint32_t last_tick) {
+        if constexpr (Side == Order_Type::Buy) { return last_tick >= trigger_tick; }
+        else { return last_tick <= trigger_tick; }
+    }
+
+    static inline bool fires_before(uint32_t a, uint32_t b) {
+        if constexpr (Side == Order_Type::Buy) { return a < b; }
+        else { return a > b; }
+    }
+
+    inline bool accepts(uint32_t order_id, uint32_t trigger_tick) const {
+        return order_id <= MaxOrderId && in_range(trigger_tick);
+    }
+
+    inline void add(uint32_t trigger_tick, const StopOrder& stop) {
+        const uint32_t i = idx(trigger_tick);
+        index_[stop.order_id] = IndexSlot{trigger_tick, (uint32_t)levels_[i].stops.size(), true};
+        levels_[i].stops.push_back(stop);
+        ++levels_[i].live;
+        level_bits_[i / kWordBits] |= (1ULL << (i % kWordBits));
+        if (!has_next_ || fires_before(trigger_tick, next_trigger_)) {
+            next_trigger_ = trigger_tick;
+            has_next_ = true;
+        }
+    }
+
+    inline bool cancel(uint32_t order_id) {
+        if (order_id > MaxOrderId || !index_[order_id].used) { return false; }
+        const uint32_t trigger = index_[order_id].trigger_tick;
+        index_[order_id].used = false;
+        levels_[idx(trigger)].stops[index_[order_id].pos_in_level].qty = 0;
+        if (--levels_[idx(trigger)].live == 0) {
+            clear_level(trigger);
+        }
+        else {
+            maybe_compact(idx(trigger));
+        }
+        return true;
+    }
+
+    // Append every live stop crossed by last_tick to out, in firing order
+    // (nearest trigger first, then arrival), and drop them from the book.
+    inline void release_through(uint32_t last_tick, std::vector<StopOrder>& out) {
+        while (has_next_ && fires(next_trigger_, last_tick)) {
+            const uint32_t trigger = next_trigger_;
+            for (const StopOrder& s : levels_[idx(trigger)].stops) {
+                if (s.qty == 0) { continue; } // cancelled
+                index_[s.order_id].used = false;
+                out.push_back(s);
+            }
+            clear_level(trigger);
+        }
+    }
+
+    // Mass cancel: drop every live stop triggering lo..hi that match(stop) picks,
+    // calling on_cancel(order_id) for each. Walks only the set level bits in the
+    // range and finds the next trigger once at the end. Returns how many went.
+    template <typename Match, typename OnCancel>
+    inline uint32_t cancel_where(uint32_t lo, uint32_t hi, Match&& match, OnCancel&& on_cancel) {
+        if (lo < MinPrice) { lo = MinPrice; }
+        if (hi > MaxPrice) { hi = MaxPrice; }
+        if (lo > hi) { return 0; }
+        const uint32_t lo_i = idx(lo);
+        const uint32_t hi_i = idx(hi);
+        uint32_t removed = 0;
+        for (uint32_t word = lo_i / kWordBits; word <= hi_i / kWordBits; ++word) {
+            uint64_t w = level_bits_[word];
+            if (word == lo_i / kWordBits) { w &= ~0ULL << (lo_i % kWordBits); }
+            if (word == hi_i / kWordBits && hi_i % kWordBits != 63) {
+                w &= (1ULL << (hi_i % kWordBits + 1)) - 1;
+            }
+            while (w != 0) {
+                const uint32_t i = word * kWordBits + (uint32_t)__builtin_ctzll(w);
+                w &= w - 1;
+                Level& level = levels_[i];
+                for (StopOrder& s : level.stops) {
+                    if (s.qty == 0 || !match(s)) { continue; }
+                    index_[s.order_id].used = false;
+                    s.qty = 0;
+                    --level.live;
+                    on_cancel(s.order_id);
+                    ++removed;
+                }
+                if (level.live == 0) {
+                    level.stops.clear();
+                    level_bits_[word] &= ~(1ULL << (i % kWordBits));
+                }
+                else {
+                    maybe_compact(i);
+                }
+            }
+        }
+        if (removed != 0 && has_next_) { has_next_ = scan_from(next_trigger_, next_trigger_); }
+        return removed;
+    }
+
+    inline bool empty() const { return !has_next_; }
+};
@@ -6,6 +6,11 @@
 #include <linux/ip.h>
 #include <linux/udp.h>
 
+// order entry ports, keep in step with UDP_PORT and FEED_B_PORT in xdp_recv.cpp.
+// B is the second line of an A/B feed (feed_arb.h), 0 when there is none
+#define FEED_A_PORT 9000
+#define FEED_B_PORT 9010
+
 struct {   // define a BPF map
   __uint(type, BPF_MAP_TYPE_XSKMAP);  // map type = XSKMAP (AF_XDP sockets)
   __uint(max_entries, 64);   // how many queues/entries max
@@ -13,6 +18,115 @@ struct {   // define a BPF map
   __type(value, __u32);   // value is xdp socket fd
 } xsks_map SEC(".maps");  // put map in the ".maps" section
 
+// Per-source rate limit, so one client flooding a port can't fill our RX ring and
+// UMEM ahead of everyone else. Each source ip:port has a token bucket per feed line
+// (dest port), so the A and B copies of an arbitrated flow don't split one limit.
+// A bucket is kept in nanoseconds of credit: it earns 1ns per ns, holds at most
+// burst_ns, and a message costs cost_ns. User space writes rl_config (xdp_recv.cpp);
+// cost_ns 0 = off.
+// Buckets race between CPUs, fine with one RX queue and close enough beyond that.
+// Keep the structs in step with RateLimitConfig / RateLimitStats in xdp_recv.cpp.
+struct rl_key {
+  __u32 saddr;
+  __u16 sport;
+  __u16 dport; // feed line
+};
+
+struct rl_bucket {
+  __u64 credit_ns;
+  __u64 last_ns;
+};
+
+struct rl_config {
+  __u64 cost_ns;    // ns of credit per message
+  __u64 burst_ns;   // bucket size
+  __u32 pass;       // 1: over-limit packets go up the kernel stack instead of being dropped
+  __u32 pad;
+};
+
+struct rl_stats {
+  __u64 limited_pkts; // over the limit, never reached the socket
+  __u64 limited_msgs;
+  __u64 new_sources;  // buckets created, evicted ones included
+};
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH); // idle sources age out instead of filling it
+  __uint(max_entries, 65536);
+  __type(key, struct rl_key);
+  __type(value, struct rl_bucket);
+} rl_buckets SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct rl_config);
+} rl_config SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY); // user space sums the cpus
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct rl_stats);
+} rl_stats SEC(".maps");
+
+// messages in the datagram: a wire v2 batch (version 2, count, 8-byte header, 20
+// bytes a message, see recv_helper.h) counts as its batch, anything else as one
+static __always_inline __u64 datagram_msgs(struct udphdr *udp, void *data_end) {
+  __u8 *payload = (void *)(udp + 1);
+  if ((void *)(payload + 2) > data_end) {
+    return 1;
+  }
+  __u32 count = payload[1];
+  if (payload[0] != 2 || count == 0 || count > 64 ||
+      __bpf_ntohs(udp->len) != sizeof(*udp) + 8 + 20 * count) {
+    return 1;
+  }
+  return count;
+}
+
+// 0 while the source has credit for this datagram, else the verdict for it
+static __always_inline int over_limit(struct iphdr *ip, struct udphdr *udp, void *data_end, __u64 now) {
+  __u32 zero = 0;
+  struct rl_config *cfg = bpf_map_lookup_elem(&rl_config, &zero);
+  if (!cfg || cfg->cost_ns == 0) {
+    return 0;
+  }
+  __u64 msgs = datagram_msgs(udp, data_end);
+  __u64 cost = cfg->cost_ns * msgs;
+  struct rl_key key = {.saddr = ip->saddr, .sport = udp->source, .dport = udp->dest};
+  struct rl_bucket *b = bpf_map_lookup_elem(&rl_buckets, &key);
+  if (!b) { // new source starts with a full bucket
+    struct rl_bucket fresh = {.credit_ns = cfg->burst_ns, .last_ns = now};
+    struct rl_stats *st = bpf_map_lookup_elem(&rl_stats, &zero);
+    if (st) {
+      st->new_sources++;
+    }
+    bpf_map_update_elem(&rl_buckets, &key, &fresh, BPF_ANY);
+    b = bpf_map_lookup_elem(&rl_buckets, &key);
+    if (!b) {
+      return 0;
+    }
+  }
+  __u64 credit = b->credit_ns + (now > b->last_ns ? now - b->last_ns : 0);
+  if (credit > cfg->burst_ns) {
+    credit = cfg->burst_ns;
+  }
+  b->last_ns = now;
+  if (credit < cost) {
+    b->credit_ns = credit;
+    struct rl_stats *st = bpf_map_lookup_elem(&rl_stats, &zero);
+    if (st) {
+      st->limited_pkts++;
+      st->limited_msgs += msgs;
+    }
+    return cfg->pass ? XDP_PASS : XDP_DROP;
+  }
+  b->credit_ns = credit - cost;
+  return 0;
+}
+
 SEC("xdp") // this function runs at XDP hook
 int xdp_redirect_udp_9000(struct xdp_md *ctx) { 
 
@@ -41,10 +155,28 @@ int xdp_redirect_udp_9000(struct xdp_md *ctx) {
       return XDP_PASS;
     }
 
-    if (udp->dest != __bpf_htons(9000)) { // only port 9000
+    if (udp->dest != __bpf_htons(FEED_A_PORT) &&
+        (FEED_B_PORT == 0 || udp->dest != __bpf_htons(FEED_B_PORT))) { // only our lines
       return XDP_PASS; 
     }
 
+    // before the redirect, so a flood never takes a UMEM frame or an RX ring slot
+    __u64 now = bpf_ktime_get_ns();
+    int verdict = over_limit(ip, udp, data_end, now);
+    if (verdict) {
+      return verdict;
+    }
+
+    // receive timestamp in the metadata area just ahead of the packet, AF_XDP copies
+    // it along (frame_rx_ns in recv_helper.h). Same clock as CLOCK_MONOTONIC in user
+    // space. If the driver has no metadata support the user side reads 0 and skips it.
+    if (bpf_xdp_adjust_meta(ctx, -(int)sizeof(__u64)) == 0) {
+      __u64 *meta = (void *)(long)ctx->data_meta;
+      if ((void *)(meta + 1) <= (void *)(long)ctx->data) { // verifier wants the bounds check
+        *meta = now;
+      }
+    }
+
     int qid = ctx->rx_queue_index; // which recv queue this packet came in on
     return bpf_redirect_map(&xsks_map, qid, 0); // send packet to AF_XDP socket for qid
 }
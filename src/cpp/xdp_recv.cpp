@@ -1,10 +1,20 @@
 #include <iostream>
 #include <cstring>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <memory>
 #include <cstdio>
 #include "recv_helper.h"
 #include "match.h"
+#include "inline_match.h"
 #include "send_from_engine.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "placement.h"
+#include "replica.h"
+#include "tcp_gateway.h"
+#include "local_ingress.h"
 #include "../cpp_helpers/protocols.hpp"
 #include <cstdlib>
 #include <unistd.h>
@@ -35,10 +45,27 @@
 static constexpr uint32_t FRAME_SIZE = 2048;    // size of one packet buffer
 static constexpr uint32_t NUM_FRAMES = 65536;    // how many packet buffers in UMEM
 static constexpr uint32_t BATCH = 64;           // process packets in chunks
+static constexpr uint32_t XDP_STATS_EVERY = 1024; // batches between XDP_STATISTICS reads
+static constexpr Pipeline PIPELINE = Pipeline::ThreeThread; // or RunToCompletion, see inline_match.h
+static constexpr bool REPLICA = true; // journal the matched stream for a standby (replica.h)
+static constexpr OverloadPolicy OVERLOAD = OverloadPolicy::Block;  // Block, Shed or Nack (three-thread only)
+static constexpr uint32_t OVERLOAD_HIGH_WATER = ORDER_RING_SIZE * 3 / 4; // rest kept for cancels
 static constexpr int UDP_PORT = 9000;                                
+static constexpr uint16_t FEED_B_PORT = 9010; // B line of an A/B feed (feed_arb.h), 0 = off; matches xdp_kernal.c
+static constexpr uint32_t RATE_LIMIT_MSGS = 200000; // per source ip:port per second in xdp_kernal.c, 0 = off
+static constexpr uint32_t RATE_LIMIT_BURST = 8192;  // messages a source may send at once over the rate
+static constexpr bool RATE_LIMIT_PASS = false;      // over-limit packets up the kernel stack instead of dropped
 static constexpr const char* IFACE_NAME = "ens160";
 static constexpr const char* TRADE_DST_IP = "192.168.37.1";
 static constexpr uint16_t TRADE_DST_PORT = 9001;
+static constexpr uint16_t TCP_GATEWAY_PORT = 9002; // TCP order entry (tcp_gateway.h), 0 = off; three-thread only
+static constexpr bool LOCAL_INGRESS = true; // shared-memory order entry (local_ingress.h); three-thread only
+
+// per-thread wait strategies (SpinWait, BusySpinWait, UmwaitWait, FutexWait; see spsc_ring.h)
+using RecvWait = BusySpinWait;   // only waits when the order ring is full
+using MatchWait = BusySpinWait;  // pinned hot path, never leave the core
+using SendWait = UmwaitWait;     // off the critical path, nap in C0.1 between reports
+using GatewayWait = SpinWait;    // only waits when the gateway ring is full
 
 __attribute__((noinline))
 static void die(const char* msg) { 
@@ -79,7 +106,8 @@ static void handle_sig(int) {
 static bool pin_thread_to_cpu(pthread_t tid, int cpu, const char* label) {
 #if defined(__linux__)
     long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
-    if (cpu < 0 || cpu_count <= 0 || cpu >= cpu_count) {
+    if (cpu < 0) { return false; } // the plan left it unpinned
+    if (cpu_count <= 0 || cpu >= cpu_count) {
         std::cerr << "pin " << label << " skipped: cpu " << cpu
             << " not in [0," << (cpu_count - 1) << "]\n";
         return false;
@@ -106,12 +134,147 @@ static void pin_current_thread(int cpu, const char* label) {
     pin_thread_to_cpu(pthread_self(), cpu, label);
 }
 
-int main() {
+// rl_config and rl_stats in xdp_kernal.c, keep in step
+struct RateLimitConfig {
+    uint64_t cost_ns;
+    uint64_t burst_ns;
+    uint32_t pass;
+    uint32_t pad;
+};
+
+struct RateLimitStats {
+    uint64_t limited_pkts;
+    uint64_t limited_msgs;
+    uint64_t new_sources;
+};
+
+// the kernel's token buckets count nanoseconds of credit, so it never divides
+static void set_rate_limit(bpf_object* obj) {
+    int fd = bpf_object__find_map_fd_by_name(obj, "rl_config");
+    if (fd < 0) {
+        die("find rl_config");
+    }
+    RateLimitConfig cfg{};
+    if (RATE_LIMIT_MSGS != 0) {
+        cfg.cost_ns = std::max<uint64_t>(1'000'000'000ULL / RATE_LIMIT_MSGS, 1);
+        cfg.burst_ns = cfg.cost_ns * std::max<uint32_t>(RATE_LIMIT_BURST, WIRE_V2_MAX_MSGS);
+        cfg.pass = RATE_LIMIT_PASS ? 1 : 0;
+    }
+    uint32_t key = 0;
+    if (bpf_map_update_elem(fd, &key, &cfg, BPF_ANY) != 0) {
+        die("bpf_map_update_elem rl_config");
+    }
+    if (RATE_LIMIT_MSGS != 0) {
+        std::cout << "rate limit: " << RATE_LIMIT_MSGS << " msgs/s per source, burst "
+            << cfg.burst_ns / cfg.cost_ns << ", excess " << (RATE_LIMIT_PASS ? "passed" : "dropped") << "\n";
+    }
+}
+
+// kernel-side drops we never see as descriptors; counters are cumulative per socket
+// and, for the rate limiter, per cpu
+static void sample_xdp_stats(int xsk_fd, int rl_stats_fd, RecvMetrics& m) {
+    xdp_statistics st{};
+    socklen_t len = sizeof(st);
+    if (getsockopt(xsk_fd, SOL_XDP, XDP_STATISTICS, &st, &len) == 0) {
+        m.xdp_drops.set(st.rx_dropped + st.rx_ring_full);
+        m.fq_empty.set(st.rx_fill_ring_empty_descs);
+    }
+    static std::vector<RateLimitStats> cpus(std::max(libbpf_num_possible_cpus(), 1));
+    uint32_t key = 0;
+    if (bpf_map_lookup_elem(rl_stats_fd, &key, cpus.data()) != 0) { return; }
+    RateLimitStats sum{};
+    for (const RateLimitStats& c : cpus) {
+        sum.limited_pkts += c.limited_pkts;
+        sum.limited_msgs += c.limited_msgs;
+        sum.new_sources += c.new_sources;
+    }
+    m.rate_limited.set(sum.limited_pkts);
+    m.rate_limited_msgs.set(sum.limited_msgs);
+    m.rate_sources.set(sum.new_sources);
+}
+
+// a gateway session as the primary left it, for TcpGateway::resume
+struct GwResume {
+    uint32_t key = 0;
+    uint32_t next_seq = 1;
+    bool bound = false;
+};
+
+// Ingress state rebuilt from the journal: every Bind gives a session id's key, and
+// every message's seq goes through its session's dedupe window (UDP) or moves its
+// next seq (gateway) the way the primary's ingress did when it let it through.
+// Local sessions are fixed per slot, and a new owner binds its slot again on its
+// first message, so they need nothing.
+static void rebuild_sessions(const OrderMsg& m, SessionTable<UDP_SESSIONS>& udp, std::vector<GwResume>& gw) {
+    if (m.session == CONTROL_SESSION) {
+        if (static_cast<Control>(m.msg_type) != Control::Bind) { return; }
+        if (m.qty < UDP_SESSIONS) { udp.restore(m); }
+        else if (m.qty < LOCAL_SESSION_BASE) { gw[m.qty - UDP_SESSIONS] = GwResume{m.order_id, 1, true}; }
+        return;
+    }
+    if (m.session < UDP_SESSIONS) {
+        uint32_t skipped;
+        udp.window(m.session).is_duplicate(m.seq_num, skipped);
+    }
+    else if (m.session < LOCAL_SESSION_BASE) {
+        gw[m.session - UDP_SESSIONS].next_seq = m.seq_num + 1;
+    }
+}
+
+// --standby: replay the primary's journal until the primary goes away, then hand
+// the warm Matcher back so this process carries on as the primary, with the
+// primary's session ids and dedupe state in udp and gw
+static std::unique_ptr<Matcher> run_standby(SessionTable<UDP_SESSIONS>& udp, std::vector<GwResume>& gw) {
+    const ReplicaSegment* seg = nullptr;
+    std::cout << "standby: waiting for a primary\n";
+    bool wrapped = false;
+    while (!(seg = replica_attach(REPLICA_SHM_NAME, &wrapped))) {
+        if (wrapped) {
+            std::cerr << "standby: the primary's journal has already wrapped (" << REPLICA_RECORDS
+                << " records) and there is no snapshot to start from, restart it with a standby\n";
+            std::exit(1);
+        }
+        if (!g_running.load(std::memory_order_acquire)) { std::exit(0); }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    std::cout << "standby: following primary pid " << seg->pid << "\n";
+    auto engine = std::make_unique<Matcher>();
+    if (OPENING_AUCTION_NS != 0) { engine->begin_auction(); }
+    uint64_t applied = 0;
+    gw.assign(LOCAL_SESSION_BASE - UDP_SESSIONS, GwResume{});
+    const FollowEnd end = replica_follow(seg, *engine, g_running, applied,
+                                         [&](const OrderMsg& m) { rebuild_sessions(m, udp, gw); });
+    munmap(const_cast<ReplicaSegment*>(seg), sizeof(ReplicaSegment));
+    udp.tick(metrics_now_ns());
+    udp.touch_all();
+    switch (end) {
+        case FollowEnd::PrimaryGone:
+            std::cout << "standby: primary gone after " << applied << " records, exec_seq "
+                << engine->exec_seq() << ", taking over (without a journal, no standby can follow)\n";
+            return engine;
+        case FollowEnd::Diverged:
+            std::cerr << "standby: diverged from the primary at record " << applied - 1 << "\n";
+            std::exit(1);
+        case FollowEnd::Overrun:
+            std::cerr << "standby: fell a whole journal behind, can't take over\n";
+            std::exit(1);
+        case FollowEnd::Stopped:
+            break;
+    }
+    std::exit(0);
+}
+
+int main(int argc, char** argv) {
 
     const char* ifname = IFACE_NAME;
     const char* dst_ip = TRADE_DST_IP;
     const uint16_t dst_port = TRADE_DST_PORT;
     const uint32_t queue_id = 0; // use queue 0
+    const bool standby = argc > 1 && std::strcmp(argv[1], "--standby") == 0;
+    if (argc > 1 && !standby) {
+        std::cerr << "usage: " << argv[0] << " [--standby]\n";
+        return 1;
+    }
 
     libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
     std::signal(SIGINT, handle_sig);
@@ -134,7 +297,7 @@ int main() {
     ucfg.fill_size = NUM_FRAMES;   // how many entries in fill queue
     ucfg.comp_size = NUM_FRAMES;   // how many entries in comp queue
     ucfg.frame_size = FRAME_SIZE;  // each buffer size
-    ucfg.frame_headroom = 0;       // no extra room
+    ucfg.frame_headroom = 0;       // XDP metadata (rx_ns) sits in the kernel's own headroom ahead of this
     ucfg.flags = 0;
 
     // register with kernal
@@ -163,6 +326,12 @@ int main() {
         die("bpf_object__load");  
     }  
 
+    set_rate_limit(obj); // before attach, so the first packet already sees it
+    int rl_stats_fd = bpf_object__find_map_fd_by_name(obj, "rl_stats");
+    if (rl_stats_fd < 0) {
+        die("find rl_stats");
+    }
+
     bpf_program* prog = bpf_object__find_program_by_name(obj, "xdp_redirect_udp_9000"); // find function
     if (!prog) {
         die("find_program"); // die if not found   
@@ -173,6 +342,13 @@ int main() {
         die("prog_fd");  
     }  
 
+    // standby: everything above is ready, attach once the primary has let go of the
+    // interface (before the atexit below, so a standby that gives up leaves it alone)
+    auto sessions = std::make_unique<SessionTable<UDP_SESSIONS>>(); // per source ip:port dedupe
+    std::vector<GwResume> gw_resume;
+    std::unique_ptr<Matcher> warm;
+    if (standby) { warm = run_standby(*sessions, gw_resume); }
+
     int ifindex = if_nametoindex(ifname); // convert "eth0" -> numeric ifindex
     if (ifindex == 0) {
         die("if_nametoindex");
@@ -231,31 +407,95 @@ int main() {
     std::cout << "Engine listening on " << ifname  << " queue " << queue_id 
     << " for UDP dst port " << UDP_PORT << "\n";
 
-    DedupeWindow dd;
+    MetricsSegment* metrics = metrics_create(); // read live with ./metrics_top
+    if (!metrics) {
+        die("metrics_create");
+    }
+
+    std::unique_ptr<FeedArb> arb;        // both lines share the sessions' windows
+    if (FEED_B_PORT != 0) {
+        arb = std::make_unique<FeedArb>(UDP_SESSIONS, UDP_PORT, FEED_B_PORT);
+        std::cout << "A/B feed: line B on UDP port " << FEED_B_PORT << "\n";
+    }
+    RecvWait ring_wait;
+    ring_wait.stats = &metrics->recv.wait;
+    NackSender nacks(dst_ip, dst_port);
     OrderMsgRing ring;
-    TradeMsgRing trade_ring;
-    std::atomic<uint64_t> orders_total{0};
-    std::atomic<uint64_t> trades_total{0};
+    ReportRing report_ring;
     std::atomic<bool> stats_started{false};
     std::atomic<uint64_t> stats_start_ns{0};
+    BookSnapshot book_snapshot; // matcher publishes, stats reads
+    // after a takeover there is no journal: a new standby would start from an empty book
+    std::unique_ptr<ReplicaFeed> replica;
+    if (REPLICA && !standby) {
+        replica = std::make_unique<ReplicaFeed>();
+        if (!replica->on()) { replica.reset(); }
+    }
+    std::cout << "replica journal " << (replica ? "on" : "off") << (standby ? " (took over)" : "") << "\n";
+
+    // the gateway feeds the matcher thread, so it needs the three-thread layout
+    constexpr bool with_gateway = TCP_GATEWAY_PORT != 0 && PIPELINE == Pipeline::ThreeThread;
+    std::unique_ptr<OrderMsgRing> gateway_ring;
+    std::unique_ptr<GwReportRing> gateway_reports;
+    std::unique_ptr<TcpGateway<GatewayWait>> gateway;
+    if (with_gateway) {
+        gateway_ring = std::make_unique<OrderMsgRing>();
+        gateway_reports = std::make_unique<GwReportRing>();
+        gateway = std::make_unique<TcpGateway<GatewayWait>>(TCP_GATEWAY_PORT, *gateway_ring,
+                                                            *gateway_reports, metrics->gateway,
+                                                            g_running);
+        for (uint32_t i{}; i < gw_resume.size(); i++) {
+            if (gw_resume[i].bound) {
+                gateway->resume(gw_resume[i].key, (uint16_t)(UDP_SESSIONS + i), gw_resume[i].next_seq);
+            }
+        }
+        std::cout << "TCP gateway on port " << TCP_GATEWAY_PORT << "\n";
+    }
 
-    pin_current_thread(1, "xdp_recv_main");
-
-    std::thread matcher([&ring, &trade_ring, &trades_total]() {
-        match_loop(ring, trade_ring, g_running, trades_total);
-    });
-    pin_thread_to_cpu(matcher.native_handle(), 2, "matcher");
-    std::thread trade_sender = start_trade_sender(trade_ring, dst_ip, dst_port, g_running);
-    pin_thread_to_cpu(trade_sender.native_handle(), 3, "trade_sender");
+    std::unique_ptr<LocalIngress> local;
+    if (LOCAL_INGRESS && PIPELINE == Pipeline::ThreeThread) {
+        local = std::make_unique<LocalIngress>();
+        if (!local->on()) { local.reset(); }
+    }
+    std::cout << "local order entry " << (local ? "on" : "off") << "\n";
+
+    const Topology topo = Topology::discover(ifname, queue_id);
+    const Placement place = Placement::plan(topo, PIPELINE == Pipeline::RunToCompletion, with_gateway);
+    place.print(topo, ifname, queue_id);
+    pin_current_thread(place.recv, "xdp_recv_main");
+
+    std::thread matcher;
+    std::thread report_sender;
+    std::thread gateway_thread;
+    if (PIPELINE == Pipeline::ThreeThread) {
+        matcher = std::thread([&ring, &report_ring, metrics, &book_snapshot, &replica, &warm, &gateway_ring,
+                               &local, &gateway_reports]() {
+            match_loop<MatchWait>(ring, report_ring, g_running, metrics->match, &book_snapshot,
+                                  replica.get(), warm.get(), gateway_ring.get(), local.get(),
+                                  gateway_reports.get());
+        });
+        pin_thread_to_cpu(matcher.native_handle(), place.matcher, "matcher");
+        report_sender = start_report_sender<SendWait>(report_ring, dst_ip, dst_port, g_running,
+                                                      metrics->send);
+        pin_thread_to_cpu(report_sender.native_handle(), place.sender, "report_sender");
+    }
+    if (gateway) {
+        gateway_thread = std::thread([&gateway]() { gateway->run(); });
+        pin_thread_to_cpu(gateway_thread.native_handle(), place.gateway, "tcp_gateway");
+    }
+    std::cout << "pipeline " << (PIPELINE == Pipeline::ThreeThread ? "three-thread" : "run-to-completion")
+        << "\n";
     // stats thread is just for the thruput tables
-    std::thread stats_thread([&orders_total, &trades_total, &stats_started, &stats_start_ns]() {
+    std::thread stats_thread([metrics, &stats_started, &stats_start_ns, &book_snapshot]() {
+        const Counter& orders_total = metrics->recv.orders;
+        const Counter& trades_total = metrics->match.trades;
         std::filesystem::create_directories("data");
         std::ofstream out("data/stats.csv", std::ios::trunc);
         if (!out) {
             std::perror("stats.csv");
             return;
         }
-        out << "sec,orders_per_sec,trades_per_sec,total_orders,total_trades\n";
+        out << "sec,orders_per_sec,trades_per_sec,total_orders,total_trades,best_bid,best_ask\n";
         uint64_t last_orders = 0; uint64_t last_trades = 0;
         uint64_t last_ts = 0; uint64_t next_sample = 0;
         const uint64_t start_offset = 2'500'000ULL;
@@ -269,8 +509,8 @@ int main() {
             uint64_t now = steady_ns();
             if (last_ts == 0) {
                 last_ts = stats_start_ns.load(std::memory_order_relaxed);
-                last_orders = orders_total.load(std::memory_order_relaxed);
-                last_trades = trades_total.load(std::memory_order_relaxed);
+                last_orders = orders_total.get();
+                last_trades = trades_total.get();
                 next_sample = last_ts + start_offset;
                 continue;
             }
@@ -278,14 +518,19 @@ int main() {
                 std::this_thread::sleep_for(std::chrono::microseconds(200));
                 continue;
             }
-            uint64_t orders = orders_total.load(std::memory_order_relaxed);
-            uint64_t trades = trades_total.load(std::memory_order_relaxed);
+            uint64_t orders = orders_total.get();
+            uint64_t trades = trades_total.get();
             uint64_t elapsed = next_sample - last_ts;
             double sec = (next_sample - stats_start_ns.load(std::memory_order_relaxed)) / 1e9;
             double ops = (orders - last_orders) * 1e9 / (double)elapsed;
             double tps = (trades - last_trades) * 1e9 / (double)elapsed;
+            BookView top{};
+            book_snapshot.read(top);
+            uint32_t best_bid = top.bid_levels ? top.bids[0].price_tick : 0;
+            uint32_t best_ask = top.ask_levels ? top.asks[0].price_tick : 0;
             out << std::fixed << std::setprecision(3)
-                << sec << "," << ops << "," << tps << "," << orders << "," << trades << "\n";
+                << sec << "," << ops << "," << tps << "," << orders << "," << trades
+                << "," << best_bid << "," << best_ask << "\n";
             out.flush();
             last_ts = next_sample;
             last_orders = orders;
@@ -296,8 +541,25 @@ int main() {
             }
         }
     });
-    pin_thread_to_cpu(stats_thread.native_handle(), 4, "stats");
+    pin_thread_to_cpu(stats_thread.native_handle(), place.stats, "stats");
     // loop: poll Recv ring, handle packets, then recycle buffers
+    RecvMetrics& rm = metrics->recv;
+    StagePerf perf(rm.perf); // on this thread, so after pin_current_thread
+    std::cout << "stage perf counters " << (perf.on() ? "on" : "off (no PMU access)") << "\n";
+    uint32_t batches = 0;
+    // a v2 frame holds up to WIRE_V2_MAX_MSGS messages, plus a Bind for a new session
+    std::vector<RxMsg> msgs(BATCH * RX_MSGS_PER_FRAME);
+    std::vector<RxMsg> shed(BATCH * RX_MSGS_PER_FRAME);
+    static_assert(BATCH * RX_MSGS_PER_FRAME <= OVERLOAD_HIGH_WATER, "one RX batch must fit the order ring");
+    // run-to-completion: the matcher and report packing live on this thread
+    std::unique_ptr<InlineMatcher> inline_matcher;
+    std::unique_ptr<ReportBatcher> inline_reports;
+    if (PIPELINE == Pipeline::RunToCompletion) {
+        inline_matcher = std::make_unique<InlineMatcher>(BATCH * RX_MSGS_PER_FRAME, metrics->match,
+                                                         &book_snapshot, replica.get(), std::move(warm));
+        inline_reports = std::make_unique<ReportBatcher>(dst_ip, dst_port, metrics->send);
+    }
+    auto send_inline = [&](const ExecReport& r) { inline_reports->push(r); };
     while (g_running.load(std::memory_order_acquire)) {
         pollfd pfd{};
         pfd.fd = xsk_fd; // poll on xsk fd
@@ -307,67 +569,103 @@ int main() {
             die("poll");   
         } 
         if (pret == 0) {
+            sample_xdp_stats(xsk_fd, rl_stats_fd, rm);
+            if (PIPELINE == Pipeline::RunToCompletion) {
+                inline_matcher->on_idle(send_inline);
+                inline_reports->flush();
+            }
             continue; // timeout: just loop
         }
+        if (++batches % XDP_STATS_EVERY == 0) {
+            sample_xdp_stats(xsk_fd, rl_stats_fd, rm);
+        }
 
         uint32_t rx_idx = 0; // where packets start in recv ring
         uint32_t rcvd = xsk_ring_cons__peek(&rx, BATCH, &rx_idx); // grab up to BATCH packets
         if (rcvd == 0) {
             continue; // nothing ready 
         } 
+        perf.begin();
 
-        for (uint32_t i{}; i < rcvd; i++) { // loop over packets recieved from rx ring
-            const xdp_desc* d = xsk_ring_cons__rx_desc(&rx, rx_idx + i); // get descripter fop packet i
-            uint8_t* frame = (uint8_t*)umem_area + d->addr; // gets buffer addr
+        // validate + dedupe per session, then byte-swap the survivors straight into ring slots
+        uint32_t n = gather_payloads(
+            [&](uint32_t i) { return xsk_ring_cons__rx_desc(&rx, rx_idx + i); },
+            rcvd, (const uint8_t*)umem_area, UDP_PORT, *sessions, msgs.data(), rm, arb.get());
 
-            Packet p;
-            if (!parse_packet(frame, d->len, p, 9000)) { // parse
-                continue;
+        if (PIPELINE == Pipeline::RunToCompletion) {
+            if (n != 0 && !stats_started.exchange(true, std::memory_order_acq_rel)) {
+                stats_start_ns.store(steady_ns(), std::memory_order_release);
             }
-            if (dd.is_duplicate(p.seq_num)) {continue;}
+            inline_matcher->run(msgs.data(), n, send_inline); // match + pack reports inline
+            inline_reports->flush();
+            rm.orders.add(n);
+            n = 0; // nothing goes on the ring
+        }
 
-            OrderMsg* slot = nullptr;
-            SpinWait wait;
-            while (!ring.try_acquire_producer_slot(slot)) { // spin until slot avalible
+        // past the high-water mark only cancels get in, so the matcher can catch up
+        // and clients can still pull orders while we shed
+        constexpr uint32_t headroom = ORDER_RING_SIZE - OVERLOAD_HIGH_WATER;
+        if (OVERLOAD != OverloadPolicy::Block && n != 0 &&
+                ring.try_acquire_producer_slots(n + headroom) < n + headroom) {
+            uint32_t n_shed = 0;
+            n = keep_cancels(msgs.data(), n, shed.data(), n_shed);
+            forget_shed(*sessions, shed.data(), n_shed);
+            rm.shed.add(n_shed);
+            if (OVERLOAD == OverloadPolicy::Nack) {
+                nacks.send(shed.data(), n_shed);
+                rm.nacked.add(n_shed);
+            }
+        }
+        if (n != 0) {
+            if (ring.try_acquire_producer_slots(n) < n) {
+                rm.ring_full.add();
+            }
+            while (ring.try_acquire_producer_slots(n) < n) { // spin until slots avalible
                 if (!g_running.load(std::memory_order_acquire)) { break; }
-                wait.pause();
+                ring_wait.pause(ring.producer_wait_point());
             }
             if (!g_running.load(std::memory_order_acquire)) { break; }
-            wait.reset();
+            ring_wait.reset();
             if (!stats_started.load(std::memory_order_relaxed)) { // start stats on first packet
                 if (!stats_started.exchange(true, std::memory_order_acq_rel)) {
                     stats_start_ns.store(steady_ns(), std::memory_order_release);
                 }
             }
-            // copy stuff
-            slot->seq_num = p.seq_num;
-            slot->order_id = p.order_id;
-            slot->price_tick = p.price_tick;
-            slot->qty = p.qty;
-            slot->msg_type = p.msg_type;
-            slot->side = p.side;
-            ring.commit_producer_slot(); // advance write ptr so consumer can see
-            orders_total.fetch_add(1, std::memory_order_relaxed);
+            decode_payloads(msgs.data(), n, ring);
+            ring.commit_producer_slots(n); // advance write ptr so consumer can see
+            rm.orders.add(n);
+            const uint32_t depth = ring.producer_depth();
+            rm.ring_depth.set(depth);
+            rm.ring_hwm.max(depth);
         }
 
         // return the same buffers back into the fill ring for reuse
         uint32_t fq_idx = 0; // fill ring index
 
-        // reserve space to give buffers back
-        uint32_t reserved = xsk_ring_prod__reserve(&fq, rcvd, &fq_idx);
-        if (reserved != rcvd) {    
-            die("fq reserve (recycle)");   // die if ring is full
+        // reserve space to give buffers back. The fill ring holds every frame, so it
+        // can't stay full while we hold rcvd of them; retry rather than kill the engine
+        while (xsk_ring_prod__reserve(&fq, rcvd, &fq_idx) != rcvd) {
+            rm.fq_retry.add();
+            if (!g_running.load(std::memory_order_acquire)) { break; }
+            _mm_pause();
         }
+        if (!g_running.load(std::memory_order_acquire)) { break; }
         for (uint32_t i{}; i < rcvd; i++) { // for each packet we consumed
             const xdp_desc* d = xsk_ring_cons__rx_desc(&rx, rx_idx + i);  // get its descriptor
             *xsk_ring_prod__fill_addr(&fq, fq_idx + i) = d->addr;  // return its buffer addr to kernel
         }
         xsk_ring_prod__submit(&fq, rcvd); // submit recycled buffers
         xsk_ring_cons__release(&rx, rcvd); // tell kernel we’re done with those RX entries
+        perf.end(rcvd);
     }
-    matcher.join();
-    trade_sender.join();
+    if (matcher.joinable()) { matcher.join(); }
+    if (report_sender.joinable()) { report_sender.join(); }
+    if (gateway_thread.joinable()) { gateway_thread.join(); }
     stats_thread.join();
+    // let go of the interface before closing the journal, the standby attaches next
+    detach_xdp(g_ifindex, kXdpFlags);
+    g_ifindex = -1;
+    replica.reset();
 
     return 0;
 }
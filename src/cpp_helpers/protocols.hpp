@@ -3,8 +3,42 @@
 #include <cstdint>
 #include <type_traits>
 
-enum class MsgType : uint8_t { NewLimit = 1, Cancel=2, Modify=3};
+enum class MsgType : uint8_t { NewLimit = 1, Cancel=2, Modify=3, NewStop=4, NewStopLimit=5, MassCancel=6};
 enum class Order_Type : uint8_t { Sell = 0, Buy = 1 }; //uint8 bc may support more stuff in the future
+enum class ExecType : uint8_t { Ack = 1, Reject = 2, Trade = 3 };
+
+// MassCancel reuses the order fields: qty picks the sides (MASS_CANCEL_BIDS/ASKS,
+// stops included), price_tick..stop_tick is the price range with 0 leaving that
+// end open, order_id and side are ignored. It only reaches the sender session's
+// own orders. The ack's qty is how many were cancelled.
+static constexpr uint32_t MASS_CANCEL_BIDS = 1;
+static constexpr uint32_t MASS_CANCEL_ASKS = 2;
+
+// Engine-internal messages travel the order rings and the replica journal as
+// OrderMsgs with session CONTROL_SESSION, which no ingress ever stamps on client
+// traffic (session ids start at 1). msg_type then holds a Control kind, so nothing a
+// client puts in msg_type can be taken for one.
+static constexpr uint16_t CONTROL_SESSION = 0;
+// Bind: session id qty now belongs to a new client (order_id, price_tick and
+// stop_tick name it per ingress), which starts clean of anything the id held before.
+enum class Control : uint8_t { Uncross = 1, Bind };
+
+// why a message was rejected, carried on the wire in reject reports
+enum class RejectReason : uint8_t {
+  None = 0,
+  Session,      // session id outside the table
+  Qty,          // zero or above max_qty
+  Notional,
+  PriceBand,    // too far from the last trade
+  OpenOrders,
+  Position,
+  DuplicateId,  // new order reuses a live order id
+  PriceRange,   // outside the book's price range
+  OrderId,      // order id above MAX_ORDER_ID
+  UnknownId,    // cancel/modify of an order that isn't live
+  MsgType,
+  Overload,     // shed at ingress, order ring over its high-water mark
+};
 
 #pragma pack(push, 1)
 struct Packet {
@@ -12,12 +46,82 @@ struct Packet {
   uint32_t order_id;    // unique id 
   uint32_t price_tick;  // 1 => $0.01 so 10123 = $101.23
   uint32_t qty;         // qty
-  MsgType msg_type;     // New limit, cancel or modify
+  MsgType msg_type;     // New limit, cancel, modify, stop or mass cancel
   Order_Type side;      // Sell, Buy
+  uint32_t stop_tick;   // trigger for stops, 0 otherwise
 };
 #pragma pack(pop)
 
-static_assert(sizeof(Packet) == 18);
+static_assert(sizeof(Packet) == 22);
+
+// Wire v2: a BatchHeader then count OrderWire entries, entry i carrying seq
+// first_seq + i. One datagram amortises the per-frame XDP cost over up to
+// WIRE_V2_MAX_MSGS messages. Everything is naturally aligned from the start of
+// the UDP payload. A v1 datagram is a single 22-byte Packet, which is never
+// 8 + 20*count bytes long, so the two formats can share a port.
+static constexpr uint8_t WIRE_V2 = 2;
+static constexpr uint32_t WIRE_V2_MAX_MSGS = 64; // 1288 bytes, under a 1500 MTU
+
+struct BatchHeader {
+  uint8_t version;      // WIRE_V2
+  uint8_t count;        // OrderWire entries that follow, 1..WIRE_V2_MAX_MSGS
+  uint16_t session;     // client-chosen, one source ip can run several
+  uint32_t first_seq;   // seq of the first entry
+};
+
+struct OrderWire {
+  uint32_t order_id;
+  uint32_t price_tick;
+  uint32_t qty;
+  MsgType msg_type;
+  Order_Type side;
+  uint16_t pad;
+  uint32_t stop_tick;
+};
+
+static_assert(sizeof(BatchHeader) == 8);
+static_assert(sizeof(OrderWire) == 20);
+
+// TCP order entry (tcp_gateway.h). Every frame is a GwHeader then len bytes of
+// body, all in network order. A connection logs in once with a session key; the
+// gateway answers with the session id and the next seq it expects, so a client
+// that reconnects with the same key carries on where it left off. After that each
+// Order frame's body is one v1 Packet, with seqs per session. The gateway sends
+// the session's acks, rejects and fills back as Report frames, one ReportWire each.
+enum class GwType : uint8_t { Login = 1, LoginAck, LoginReject, Order, Report };
+
+struct GwHeader {
+  uint16_t len;         // body bytes after this header
+  GwType type;
+  uint8_t pad;
+};
+
+struct GwLogin {
+  uint32_t session_key; // client-chosen, names the seq space across reconnects
+};
+
+struct GwLoginAck {
+  uint16_t session;     // engine session id, as in OrderMsg.session
+  uint16_t pad;
+  uint32_t next_seq;    // first seq not yet accepted, 1 for a new session
+};
+
+// LoginReject body: one byte
+enum class GwRejectReason : uint8_t { InUse = 1, Full, BadLogin };
+
+static_assert(sizeof(GwHeader) == 4);
+static_assert(sizeof(GwLoginAck) == 8);
+
+// One message found in an RX frame, either a v1 Packet or a v2 entry. body points
+// at order_id (network order); the two formats agree up to side, only stop_tick moves.
+struct RxMsg {
+  const uint8_t* body;
+  uint32_t seq;         // host order
+  uint16_t session;
+  uint8_t stop_off;     // stop_tick offset from body
+  uint8_t pad;
+  uint64_t rx_ns;       // from the frame's XDP metadata, see OrderMsg
+};
 
 struct OrderMsg {
   uint32_t seq_num;
@@ -26,6 +130,9 @@ struct OrderMsg {
   uint32_t qty;
   MsgType msg_type;
   Order_Type side;
+  uint16_t session;     // sender session, from source ip:port (see SessionTable) or a gateway login
+  uint32_t stop_tick;   // trigger for stops, price_tick is the stop-limit price
+  uint64_t rx_ns;       // CLOCK_MONOTONIC when XDP saw the frame (or the gateway read it), 0 if the driver has no metadata
 };
 
 struct TradeMsg {
@@ -34,3 +141,36 @@ struct TradeMsg {
   uint32_t price_tick;
   uint32_t qty;
 };
+
+// One entry of the engine's outbound stream: an ack or reject for every message
+// plus one per trade, numbered by exec_seq in the order the matcher produced them
+struct ExecReport {
+  uint32_t exec_seq;    // engine sequence, one per report
+  uint32_t client_seq;  // seq_num of the message answered, 0 for trades
+  uint32_t order_id;    // bid order for trades
+  uint32_t other_id;    // ask order for trades, 0 otherwise
+  uint32_t price_tick;
+  uint32_t qty;
+  ExecType type;
+  RejectReason reason;
+  MsgType msg_type;     // message acked/rejected
+  uint8_t pad;
+};
+
+// ExecReport in network order, several per datagram
+#pragma pack(push, 1)
+struct ReportWire {
+  uint32_t exec_seq;
+  uint32_t client_seq;
+  uint32_t order_id;
+  uint32_t other_id;
+  uint32_t price_tick;
+  uint32_t qty;
+  ExecType type;
+  RejectReason reason;
+  MsgType msg_type;
+  uint8_t pad;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ReportWire) == 28);
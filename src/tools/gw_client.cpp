@@ -0,0 +1,228 @@
+// Test client for the TCP order-entry gateway (src/cpp/tcp_gateway.h).
+// usage: ./gw_client [host] [port] [conns] [orders_per_conn]
+//        (default 127.0.0.1 9002 1000 1000)
+// Opens conns connections, logs each in under its own session key, then sends
+// every connection's orders round-robin, BURST frames per write. Halfway through,
+// connection 0 drops and logs back in with the same key to check that the gateway
+// resumes its seqs. Report frames are read back as they come; at the end every
+// other connection must have had an ack or reject for each of its orders. Fails if
+// a login, the resume check or the report check does.
+
+#include "../cpp_helpers/protocols.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static constexpr uint32_t BURST = 32;            // order frames per write
+static constexpr uint32_t KEY_BASE = 0x67770000; // session key of connection i is KEY_BASE + i
+static constexpr uint32_t ID_SPACE = 200000;     // order ids stay under the engine's MAX_ORDER_ID
+static constexpr int REPORT_WAIT_MS = 5000;      // for the last acks after the final send
+static constexpr uint32_t REPORT_FRAME = sizeof(GwHeader) + sizeof(ReportWire);
+
+struct OrderFrame {
+    GwHeader h;
+    Packet p;
+} __attribute__((packed));
+
+// what a connection has been sent back
+struct Inbox {
+    uint8_t buf[4096];
+    uint32_t len = 0;
+    uint64_t answered = 0; // acks and rejects, one per order
+    uint64_t fills = 0;
+};
+
+static bool write_all(int fd, const void* buf, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    while (len > 0) {
+        const ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) { return false; }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* buf, size_t len) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    while (len > 0) {
+        const ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0) { return false; }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// every Report frame that has arrived, without blocking; false if the gateway
+// closed the connection or sent anything else
+static bool drain(int fd, Inbox& in) {
+    for (;;) {
+        const ssize_t n = recv(fd, in.buf + in.len, sizeof(in.buf) - in.len, MSG_DONTWAIT);
+        if (n < 0) { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+        if (n == 0) { return false; }
+        in.len += (uint32_t)n;
+        uint32_t at = 0;
+        for (; in.len - at >= REPORT_FRAME; at += REPORT_FRAME) {
+            GwHeader h;
+            ReportWire w;
+            std::memcpy(&h, in.buf + at, sizeof(h));
+            std::memcpy(&w, in.buf + at + sizeof(h), sizeof(w));
+            if (h.type != GwType::Report || ntohs(h.len) != sizeof(ReportWire)) { return false; }
+            if (w.type == ExecType::Trade) {
+                ++in.fills;
+            }
+            else {
+                ++in.answered;
+            }
+        }
+        if (at != 0) { std::memmove(in.buf, in.buf + at, in.len - at); }
+        in.len -= at;
+    }
+}
+
+// connect and log in; next_seq gets LoginAck's, -1 on any failure
+static int login(const sockaddr_in& addr, uint32_t key, uint32_t& next_seq) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { return -1; }
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    struct {
+        GwHeader h;
+        GwLogin l;
+    } req{{htons(sizeof(GwLogin)), GwType::Login, 0}, {htonl(key)}};
+    GwHeader h;
+    GwLoginAck ack;
+    if (!write_all(fd, &req, sizeof(req)) || !read_all(fd, &h, sizeof(h)) || h.type != GwType::LoginAck ||
+            ntohs(h.len) != sizeof(ack) || !read_all(fd, &ack, sizeof(ack))) {
+        close(fd);
+        return -1;
+    }
+    next_seq = ntohl(ack.next_seq);
+    return fd;
+}
+
+// alternating buy/sell limits around 10000, every other one cancels the last
+static void fill_order(OrderFrame& f, uint32_t conn, uint32_t seq, uint32_t per_conn) {
+    const uint32_t id = (conn * ((per_conn + 1) / 2) + (seq - 1) / 2) % ID_SPACE + 1;
+    const bool cancel = (seq % 2) == 0;
+    f.h = GwHeader{htons(sizeof(Packet)), GwType::Order, 0};
+    f.p.seq_num = htonl(seq);
+    f.p.order_id = htonl(id);
+    f.p.price_tick = htonl(10000 + (id % 16) - 8);
+    f.p.qty = htonl(1 + id % 100);
+    f.p.msg_type = cancel ? MsgType::Cancel : MsgType::NewLimit;
+    f.p.side = (id & 1) ? Order_Type::Buy : Order_Type::Sell;
+    f.p.stop_tick = 0;
+}
+
+int main(int argc, char** argv) {
+    const char* host = (argc > 1) ? argv[1] : "127.0.0.1";
+    const uint16_t port = (argc > 2) ? (uint16_t)std::atoi(argv[2]) : 9002;
+    const uint32_t conns = (argc > 3) ? (uint32_t)std::atoi(argv[3]) : 1000;
+    const uint32_t per_conn = (argc > 4) ? (uint32_t)std::atoi(argv[4]) : 1000;
+    if (conns == 0 || per_conn < 2) {
+        std::fprintf(stderr, "usage: %s [host] [port] [conns] [orders_per_conn]\n", argv[0]);
+        return 1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        std::fprintf(stderr, "invalid host %s\n", host);
+        return 1;
+    }
+
+    std::vector<int> fds(conns);
+    std::vector<uint32_t> next(conns);
+    for (uint32_t i{}; i < conns; i++) {
+        fds[i] = login(addr, KEY_BASE + i, next[i]);
+        if (fds[i] < 0) {
+            std::perror("login");
+            std::fprintf(stderr, "connection %u failed to log in\n", i);
+            return 1;
+        }
+    }
+    std::printf("%u sessions logged in, first next_seq %u\n", conns, next[0]);
+
+    // a rerun with the same keys carries on from each session's next_seq
+    std::vector<OrderFrame> burst(BURST);
+    std::vector<Inbox> inbox(conns);
+    uint64_t sent = 0;
+    bool resumed = false;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t off = 0; off < per_conn; off += BURST) {
+        const uint32_t k = (per_conn - off < BURST) ? per_conn - off : BURST;
+        for (uint32_t i{}; i < conns; i++) {
+            for (uint32_t j{}; j < k; j++) { fill_order(burst[j], i, next[i] + off + j, per_conn); }
+            if (!write_all(fds[i], burst.data(), k * sizeof(OrderFrame))) {
+                std::perror("send");
+                return 1;
+            }
+            sent += k;
+            if (!drain(fds[i], inbox[i])) {
+                std::fprintf(stderr, "connection %u: bad report stream\n", i);
+                return 1;
+            }
+        }
+        // halfway: drop connection 0 and log back in, the gateway should want the next seq
+        if (!resumed && off + k >= per_conn / 2) {
+            // read to EOF before closing: unread reports would make the close a reset,
+            // and the gateway would lose the orders it hasn't read yet
+            shutdown(fds[0], SHUT_WR);
+            char sink[4096];
+            while (recv(fds[0], sink, sizeof(sink), 0) > 0) {}
+            close(fds[0]);
+            const uint32_t expect = next[0] + off + k;
+            uint32_t want = 0;
+            for (int tries = 0; tries < 100 && (fds[0] = login(addr, KEY_BASE, want)) < 0; tries++) {
+                usleep(1000); // the gateway may not have seen the close yet (InUse)
+            }
+            if (fds[0] < 0 || want != expect) {
+                std::fprintf(stderr, "resume failed: next_seq %u, expected %u\n", want, expect);
+                return 1;
+            }
+            inbox[0] = Inbox{}; // reports for the old connection went with it
+            resumed = true;
+        }
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // connection 0 lost whatever was in flight when it dropped, so it is left out
+    uint32_t short_conns = 0;
+    for (int waited = 0; waited <= REPORT_WAIT_MS; waited++) {
+        short_conns = 0;
+        for (uint32_t i = 1; i < conns; i++) {
+            if (inbox[i].answered < per_conn && !drain(fds[i], inbox[i])) {
+                std::fprintf(stderr, "connection %u: bad report stream\n", i);
+                return 1;
+            }
+            if (inbox[i].answered < per_conn) { ++short_conns; }
+        }
+        if (short_conns == 0) { break; }
+        usleep(1000);
+    }
+    uint64_t fills = 0;
+    for (const Inbox& in : inbox) { fills += in.fills; }
+    for (const int fd : fds) { close(fd); }
+    std::printf("%lu orders over %u connections in %.3fs, %.0f orders/s, resume ok\n",
+                sent, conns, secs, sent / secs);
+    if (short_conns != 0) {
+        std::fprintf(stderr, "%u connections missing acks after %dms\n", short_conns, REPORT_WAIT_MS);
+        return 1;
+    }
+    std::printf("reports ok, %lu fills seen\n", fills);
+    return 0;
+}
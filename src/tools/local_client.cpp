@@ -0,0 +1,144 @@
+// Test client for shared-memory order entry (src/cpp/local_ingress.h).
+// usage: ./local_client [orders] [id_base]   (default 100000 orders, ids from 1)
+//        ./local_client --check-reclaim
+// Claims a slot, then sends one order at a time and spins on the slot's report
+// ring for its ack, so each sample is a full round trip through the matcher.
+// Orders alternate new limit / cancel of it, so the book stays flat. Prints the
+// round-trip percentiles and how many reports the matcher had to drop.
+// --check-reclaim needs no engine: it runs its own LocalIngress and Matcher on a
+// private segment, has a child queue orders and die, then claims the slot and
+// checks that none of the dead child's orders are matched.
+
+#include "local_ingress.h"
+#include "matcher.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <memory>
+#include <vector>
+#include <sys/wait.h>
+
+static constexpr uint64_t ACK_TIMEOUT_NS = 1'000'000'000ULL; // engine gone or stalled
+static constexpr const char* CHECK_SHM_NAME = "/order_matcher_local_check";
+static constexpr uint32_t CHECK_STALE = 100; // orders the dead client leaves queued
+
+// match loop's local path, run until the slots are empty
+static void drain(LocalIngress& in, Matcher& engine, std::vector<ExecReport>& out) {
+    OrderMsg* m;
+    in.rescan();
+    while (in.try_acquire(m)) {
+        engine.on_msg(*m, [&](const ExecReport& r) {
+            out.push_back(r);
+            in.on_report(r, engine, true);
+        });
+        in.release();
+    }
+}
+
+static int check_reclaim() {
+    shm_unlink(CHECK_SHM_NAME);
+    LocalIngress in(CHECK_SHM_NAME);
+    if (!in.on()) { return 1; }
+    auto engine = std::make_unique<Matcher>();
+    const pid_t child = fork();
+    if (child == 0) { // resting sells at 10000, then die with them queued and the slot held
+        LocalClient dead(CHECK_SHM_NAME);
+        for (uint32_t i{}; i < CHECK_STALE && dead.on(); i++) {
+            OrderMsg o{};
+            o.order_id = i + 1;
+            o.price_tick = 10000;
+            o.qty = 1;
+            o.side = Order_Type::Sell;
+            o.msg_type = MsgType::NewLimit;
+            dead.send(o);
+        }
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    LocalClient client(CHECK_SHM_NAME);
+    if (!client.on()) {
+        std::fprintf(stderr, "check-reclaim: could not reclaim the dead client's slot\n");
+        shm_unlink(CHECK_SHM_NAME);
+        return 1;
+    }
+    OrderMsg buy{}; // would take every one of the dead client's sells
+    buy.order_id = CHECK_STALE + 1;
+    buy.price_tick = 10000;
+    buy.qty = CHECK_STALE;
+    buy.side = Order_Type::Buy;
+    buy.msg_type = MsgType::NewLimit;
+    client.send(buy);
+    std::vector<ExecReport> reports;
+    drain(in, *engine, reports);
+    uint32_t stale_reports = 0;
+    uint32_t acks = 0;
+    for (const ExecReport& r : reports) {
+        if (r.type == ExecType::Trade || r.order_id <= CHECK_STALE) { ++stale_reports; }
+        if (r.type == ExecType::Ack && r.order_id == buy.order_id) { ++acks; }
+    }
+    shm_unlink(CHECK_SHM_NAME);
+    const bool ok = stale_reports == 0 && acks == 1;
+    std::printf("check-reclaim: %u stale orders queued, %u reports for them, new client's order %s\n",
+                CHECK_STALE, stale_reports, acks == 1 ? "acked" : "not acked");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && !std::strcmp(argv[1], "--check-reclaim")) { return check_reclaim(); }
+    const uint32_t orders = (argc > 1) ? (uint32_t)std::atoi(argv[1]) : 100000;
+    const uint32_t id_base = (argc > 2) ? (uint32_t)std::atoi(argv[2]) : 1;
+    if (orders == 0 || id_base == 0) {
+        std::fprintf(stderr, "usage: %s [orders] [id_base]\n", argv[0]);
+        return 1;
+    }
+    LocalClient client;
+    if (!client.on()) {
+        std::fprintf(stderr, "no local order entry: engine not running, or every slot taken\n");
+        return 1;
+    }
+    std::printf("slot claimed, session %u\n", client.session());
+
+    std::vector<uint64_t> hist(LAT_BUCKETS);
+    uint64_t max_ns = 0;
+    uint32_t rejects = 0;
+    for (uint32_t i{}; i < orders; i++) {
+        OrderMsg m{};
+        m.order_id = id_base + i / 2;
+        m.price_tick = 10000;
+        m.qty = 1;
+        m.side = Order_Type::Buy;
+        m.msg_type = (i % 2 == 0) ? MsgType::NewLimit : MsgType::Cancel;
+        const uint64_t t0 = metrics_now_ns();
+        while (!client.send(m)) { _mm_pause(); }
+        ExecReport r;
+        for (;;) {
+            if (client.poll(r) && r.type != ExecType::Trade) { break; }
+            if (metrics_now_ns() - t0 > ACK_TIMEOUT_NS) {
+                std::fprintf(stderr, "no ack after 1s at order %u (engine %s)\n", i,
+                             client.engine_up() ? "up" : "gone");
+                return 1;
+            }
+            _mm_pause();
+        }
+        const uint64_t ns = metrics_now_ns() - t0;
+        hist[lat_bucket(ns)]++;
+        if (ns > max_ns) { max_ns = ns; }
+        if (r.type == ExecType::Reject) { ++rejects; }
+    }
+
+    auto pct = [&](double p) {
+        const uint64_t rank = (uint64_t)(p * (orders - 1));
+        uint64_t seen = 0;
+        for (uint32_t b{}; b < LAT_BUCKETS; b++) {
+            seen += hist[b];
+            if (seen > rank) { return lat_bucket_floor(b); }
+        }
+        return lat_bucket_floor(LAT_BUCKETS - 1);
+    };
+    std::printf("%u round trips  p50 %lu ns  p99 %lu ns  p99.9 %lu ns  max %lu ns\n", orders,
+                pct(0.50), pct(0.99), pct(0.999), max_ns);
+    std::printf("rejects %u  reports dropped %u\n", rejects, client.dropped());
+    return 0;
+}
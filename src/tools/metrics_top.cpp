@@ -0,0 +1,240 @@
+// Live view of the engine's shared-memory metrics (see src/cpp/metrics.h).
+// usage: ./metrics_top [interval_ms]   (default 1000, ctrl-c to stop)
+
+#include "metrics.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <signal.h>
+
+static std::atomic<bool> g_running(true);
+
+static void handle_sig(int) {
+    g_running.store(false, std::memory_order_release);
+}
+
+// every counter we show, copied out in one pass so rates line up
+struct Sample {
+    uint64_t packets, orders, parse_fail, dupes, xdp_drops, fq_empty, ring_depth, ring_full;
+    uint64_t ring_hwm, shed, nacked, fq_retry;
+    uint64_t rate_limited, rate_limited_msgs, rate_sources;
+    uint64_t sessions, session_full, session_reused, seq_gaps, seq_late;
+    uint64_t line_copies[2], line_wins[2], line_gaps[2];
+    uint64_t line_lag[2][LAT_BUCKETS];  // A/B feed, by losing line
+    uint64_t line_lag_max[2];
+    uint64_t msgs, trades, acks, rejects, report_depth, report_hwm, local_msgs, local_clients;
+    uint64_t reports, datagrams, send_errors;
+    uint64_t gw_conns, gw_accepted, gw_logins, gw_login_rejects, gw_reads, gw_orders;
+    uint64_t gw_dupes, gw_seq_gaps, gw_bad_frames, gw_ring_full;
+    uint64_t gw_reports, gw_unrouted, gw_overflows, gw_report_drops;
+    uint64_t waits[4][3]; // recv/match/send/gateway x spins/yields/sleeps
+    uint64_t perf[3][PERF_EVENTS + 1]; // recv/match/send x events, then msgs
+    uint64_t wire[2][LAT_BUCKETS];     // wire_to_match, wire_to_trade
+    uint64_t wire_max[2];
+};
+
+static void read_wait(const WaitCounters& w, uint64_t* out) {
+    out[0] = w.spins.get();
+    out[1] = w.yields.get();
+    out[2] = w.sleeps.get();
+}
+
+static void read_perf(const StageCounters& p, uint64_t* out) {
+    for (int i{}; i < PERF_EVENTS; i++) { out[i] = p.events[i].get(); }
+    out[PERF_EVENTS] = p.msgs.get();
+}
+
+static void read_hist(const LatencyHist& h, uint64_t* out, uint64_t& max) {
+    for (uint32_t i{}; i < LAT_BUCKETS; i++) { out[i] = h.buckets[i].get(); }
+    max = h.max.get();
+}
+
+// p-th percentile of the samples recorded over the interval, as its bucket's floor
+static uint64_t hist_pct(const uint64_t* cur, const uint64_t* prev, uint64_t total, double p) {
+    const uint64_t rank = (uint64_t)(p * (total - 1));
+    uint64_t seen = 0;
+    for (uint32_t i{}; i < LAT_BUCKETS; i++) {
+        seen += cur[i] - prev[i];
+        if (seen > rank) { return lat_bucket_floor(i); }
+    }
+    return lat_bucket_floor(LAT_BUCKETS - 1);
+}
+
+static Sample take(const MetricsSegment& m) {
+    Sample s{};
+    s.packets = m.recv.packets.get();
+    s.orders = m.recv.orders.get();
+    s.parse_fail = m.recv.parse_fail.get();
+    s.dupes = m.recv.dupes.get();
+    s.xdp_drops = m.recv.xdp_drops.get();
+    s.fq_empty = m.recv.fq_empty.get();
+    s.ring_depth = m.recv.ring_depth.get();
+    s.ring_full = m.recv.ring_full.get();
+    s.ring_hwm = m.recv.ring_hwm.get();
+    s.shed = m.recv.shed.get();
+    s.nacked = m.recv.nacked.get();
+    s.fq_retry = m.recv.fq_retry.get();
+    s.rate_limited = m.recv.rate_limited.get();
+    s.rate_limited_msgs = m.recv.rate_limited_msgs.get();
+    s.rate_sources = m.recv.rate_sources.get();
+    s.sessions = m.recv.sessions.get();
+    s.session_full = m.recv.session_full.get();
+    s.session_reused = m.recv.session_reused.get();
+    s.seq_gaps = m.recv.seq_gaps.get();
+    s.seq_late = m.recv.seq_late.get();
+    for (int l = 0; l < 2; l++) {
+        s.line_copies[l] = m.recv.line_copies[l].get();
+        s.line_wins[l] = m.recv.line_wins[l].get();
+        s.line_gaps[l] = m.recv.line_gaps[l].get();
+        read_hist(m.recv.line_lag[l], s.line_lag[l], s.line_lag_max[l]);
+    }
+    s.msgs = m.match.msgs.get();
+    s.trades = m.match.trades.get();
+    s.acks = m.match.acks.get();
+    s.rejects = m.match.rejects.get();
+    s.report_depth = m.match.report_depth.get();
+    s.report_hwm = m.match.report_hwm.get();
+    s.local_msgs = m.match.local_msgs.get();
+    s.local_clients = m.match.local_clients.get();
+    s.reports = m.send.reports.get();
+    s.datagrams = m.send.datagrams.get();
+    s.send_errors = m.send.send_errors.get();
+    s.gw_conns = m.gateway.connections.get();
+    s.gw_accepted = m.gateway.accepted.get();
+    s.gw_logins = m.gateway.logins.get();
+    s.gw_login_rejects = m.gateway.login_rejects.get();
+    s.gw_reads = m.gateway.reads.get();
+    s.gw_orders = m.gateway.orders.get();
+    s.gw_dupes = m.gateway.dupes.get();
+    s.gw_seq_gaps = m.gateway.seq_gaps.get();
+    s.gw_bad_frames = m.gateway.bad_frames.get();
+    s.gw_ring_full = m.gateway.ring_full.get();
+    s.gw_reports = m.gateway.reports.get();
+    s.gw_unrouted = m.gateway.reports_unrouted.get();
+    s.gw_overflows = m.gateway.report_overflows.get();
+    s.gw_report_drops = m.match.gw_report_drops.get();
+    read_wait(m.recv.wait, s.waits[0]);
+    read_wait(m.match.wait, s.waits[1]);
+    read_wait(m.send.wait, s.waits[2]);
+    read_wait(m.gateway.wait, s.waits[3]);
+    read_perf(m.recv.perf, s.perf[0]);
+    read_perf(m.match.perf, s.perf[1]);
+    read_perf(m.send.perf, s.perf[2]);
+    read_hist(m.match.wire_to_match, s.wire[0], s.wire_max[0]);
+    read_hist(m.match.wire_to_trade, s.wire[1], s.wire_max[1]);
+    return s;
+}
+
+int main(int argc, char** argv) {
+    const long interval_ms = (argc > 1) ? std::atol(argv[1]) : 1000;
+    if (interval_ms <= 0) {
+        std::fprintf(stderr, "usage: %s [interval_ms]\n", argv[0]);
+        return 1;
+    }
+    std::signal(SIGINT, handle_sig);
+    std::signal(SIGTERM, handle_sig);
+
+    const MetricsSegment* seg = metrics_attach();
+    if (!seg) {
+        return 1;
+    }
+    const pid_t pid = (pid_t)seg->pid;
+
+    Sample prev = take(*seg);
+    uint64_t prev_ns = metrics_now_ns();
+    while (g_running.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+        const Sample cur = take(*seg);
+        const uint64_t now = metrics_now_ns();
+        const double dt = (now - prev_ns) / 1e9;
+        auto rate = [dt](uint64_t a, uint64_t b) { return (a - b) / dt; };
+
+        std::printf("--- engine pid %d, up %.1fs%s\n", (int)pid, (now - seg->start_ns) / 1e9,
+                    kill(pid, 0) == 0 ? "" : " (exited)");
+        std::printf("recv   pkts/s %12.0f  orders/s %12.0f  parse_fail %10lu  dupes %10lu\n",
+                    rate(cur.packets, prev.packets), rate(cur.orders, prev.orders),
+                    cur.parse_fail, cur.dupes);
+        std::printf("       xdp_drops %9lu  fq_empty %10lu  ring_depth %10lu  ring_full %10lu\n",
+                    cur.xdp_drops, cur.fq_empty, cur.ring_depth, cur.ring_full);
+        std::printf("       ring_hwm %10lu  shed/s %12.0f  nacked %12lu  fq_retry %11lu\n",
+                    cur.ring_hwm, rate(cur.shed, prev.shed), cur.nacked, cur.fq_retry);
+        std::printf("       sessions %10lu  session_full %6lu  seq_gaps %10lu  seq_late %10lu\n",
+                    cur.sessions, cur.session_full, cur.seq_gaps, cur.seq_late);
+        if (cur.session_reused != 0) { // a full table gave idle ids to new sources
+            std::printf("       session_reused %lu\n", cur.session_reused);
+        }
+        if (cur.rate_limited != 0) { // some source went over its rate in xdp_kernal.c
+            std::printf("       limited pkts/s %6.0f  msgs/s %14.0f  total %13lu  sources %11lu\n",
+                        rate(cur.rate_limited, prev.rate_limited),
+                        rate(cur.rate_limited_msgs, prev.rate_limited_msgs), cur.rate_limited_msgs,
+                        cur.rate_sources);
+        }
+        if (cur.line_copies[1] != 0) { // A/B feed with traffic on line B
+            static const char* line_names[2] = {"A", "B"};
+            for (int l = 0; l < 2; l++) {
+                const uint64_t copies = cur.line_copies[l] - prev.line_copies[l];
+                const double won = copies ? 100.0 * (cur.line_wins[l] - prev.line_wins[l]) / copies : 0.0;
+                uint64_t lags = 0;
+                for (uint32_t i{}; i < LAT_BUCKETS; i++) { lags += cur.line_lag[l][i] - prev.line_lag[l][i]; }
+                std::printf("line %s  copies/s %10.0f  won %5.1f%%  gaps %10lu  behind ns p50 %8lu  p99 %8lu  n %lu\n",
+                            line_names[l], rate(cur.line_copies[l], prev.line_copies[l]), won, cur.line_gaps[l],
+                            lags ? hist_pct(cur.line_lag[l], prev.line_lag[l], lags, 0.50) : 0,
+                            lags ? hist_pct(cur.line_lag[l], prev.line_lag[l], lags, 0.99) : 0, lags);
+            }
+        }
+        std::printf("match  msgs/s %12.0f  trades/s %12.0f  acks %10lu  rejects %10lu\n",
+                    rate(cur.msgs, prev.msgs), rate(cur.trades, prev.trades),
+                    cur.acks, cur.rejects);
+        std::printf("       report_depth %6lu  report_hwm %8lu  local_clients %3lu  local msgs/s %10.0f\n",
+                    cur.report_depth, cur.report_hwm, cur.local_clients, rate(cur.local_msgs, prev.local_msgs));
+        std::printf("send   reports/s %9.0f  dgrams/s %12.0f  send_errors %lu\n",
+                    rate(cur.reports, prev.reports), rate(cur.datagrams, prev.datagrams),
+                    cur.send_errors);
+        if (cur.gw_accepted != 0) { // TCP gateway on and used
+            std::printf("gw     conns %11lu  orders/s %12.0f  reads/s %10.0f  logins %9lu  login_rej %lu\n",
+                        cur.gw_conns, rate(cur.gw_orders, prev.gw_orders), rate(cur.gw_reads, prev.gw_reads),
+                        cur.gw_logins, cur.gw_login_rejects);
+            std::printf("       dupes %11lu  seq_gaps %10lu  bad_frames %8lu  ring_full %10lu\n",
+                        cur.gw_dupes, cur.gw_seq_gaps, cur.gw_bad_frames, cur.gw_ring_full);
+            std::printf("       reports/s %9.0f  unrouted %10lu  overflows %9lu  ring_drops %9lu\n",
+                        rate(cur.gw_reports, prev.gw_reports), cur.gw_unrouted, cur.gw_overflows,
+                        cur.gw_report_drops);
+        }
+        static const char* names[4] = {"recv", "match", "send", "gw"};
+        for (int t = 0; t < (cur.gw_accepted != 0 ? 4 : 3); t++) {
+            std::printf("wait   %-5s spins/s %12.0f  yields/s %10.0f  sleeps/s %10.0f\n", names[t],
+                        rate(cur.waits[t][0], prev.waits[t][0]),
+                        rate(cur.waits[t][1], prev.waits[t][1]),
+                        rate(cur.waits[t][2], prev.waits[t][2]));
+        }
+        // XDP timestamp to matcher done, sampled; nothing when the driver gives no metadata
+        static const char* wire_names[2] = {"to_match", "to_trade"};
+        for (int h = 0; h < 2; h++) {
+            uint64_t total = 0;
+            for (uint32_t i{}; i < LAT_BUCKETS; i++) { total += cur.wire[h][i] - prev.wire[h][i]; }
+            if (total == 0) { continue; }
+            std::printf("wire   %-8s ns  p50 %8lu  p99 %8lu  p99.9 %8lu  max(all) %10lu  n %lu\n",
+                        wire_names[h], hist_pct(cur.wire[h], prev.wire[h], total, 0.50),
+                        hist_pct(cur.wire[h], prev.wire[h], total, 0.99),
+                        hist_pct(cur.wire[h], prev.wire[h], total, 0.999), cur.wire_max[h], total);
+        }
+        // hardware counters per message over the interval, only when the PMU was usable
+        for (int t = 0; t < 3; t++) {
+            const uint64_t msgs = cur.perf[t][PERF_EVENTS] - prev.perf[t][PERF_EVENTS];
+            if (msgs == 0) { continue; }
+            std::printf("pmu    %-5s", names[t]);
+            for (int i{}; i < PERF_EVENTS; i++) {
+                std::printf("  %s/msg %8.2f", PERF_EVENT_NAMES[i],
+                            (double)(cur.perf[t][i] - prev.perf[t][i]) / msgs);
+            }
+            std::printf("\n");
+        }
+        std::fflush(stdout);
+        prev = cur;
+        prev_ns = now;
+    }
+    return 0;
+}